@@ -0,0 +1,49 @@
+#include "arith.h"
+
+int arith_pow(long int base, long int exponent, long int *result) {
+  if (exponent < 0) {
+    if (base == 0)
+      return DIVISION_BY_ZERO;
+    if (base == 1 || base == -1)
+      *result = (exponent & 1) ? base : 1;
+    else
+      *result = 0;
+    return VALID;
+  }
+
+  // Small exponents are the common case, skip the loop for them
+  switch (exponent) {
+  case 0:
+    *result = 1;
+    return VALID;
+  case 1:
+    *result = base;
+    return VALID;
+  case 2:
+    return __builtin_mul_overflow(base, base, result) ? ARITHMETIC_OVERFLOW
+                                                      : VALID;
+  }
+  if (base >= -1 && base <= 1) {
+    *result = (base == -1 && !(exponent & 1)) ? 1 : base;
+    return VALID;
+  }
+  // |base| >= 2 so anything past 2^63 cannot fit
+  if (exponent >= 64)
+    return ARITHMETIC_OVERFLOW;
+
+  long int power = 1;
+  bool overflow = false;
+  for (;;) {
+    if (exponent & 1)
+      overflow |= __builtin_mul_overflow(power, base, &power);
+    exponent >>= 1;
+    if (!exponent)
+      break;
+    // Only squared when a higher bit still needs it
+    overflow |= __builtin_mul_overflow(base, base, &base);
+  }
+  if (overflow)
+    return ARITHMETIC_OVERFLOW;
+  *result = power;
+  return VALID;
+}
@@ -0,0 +1,70 @@
+#ifndef ARITH_H
+#define ARITH_H
+
+#include <limits.h>
+#include <stdlib.h>
+#include "parser.h"
+
+/*
+  Integer kernels shared by every engine and by constant folding, so they
+  all agree on results and on which inputs are errors.
+*/
+
+// Checked operators for parser_checked_mode, inline because the engines run
+// them in their inner loops. Each returns VALID and the result, or the
+// parser_errors code the operation raises instead of wrapping or trapping.
+
+static inline int arith_add(long int a, long int b, long int *result) {
+  return __builtin_add_overflow(a, b, result) ? ARITHMETIC_OVERFLOW : VALID;
+}
+
+static inline int arith_sub(long int a, long int b, long int *result) {
+  return __builtin_sub_overflow(a, b, result) ? ARITHMETIC_OVERFLOW : VALID;
+}
+
+static inline int arith_mul(long int a, long int b, long int *result) {
+  return __builtin_mul_overflow(a, b, result) ? ARITHMETIC_OVERFLOW : VALID;
+}
+
+static inline int arith_div(long int a, long int b, long int *result) {
+  if (__builtin_expect(b == 0, 0))
+    return DIVISION_BY_ZERO;
+  // idiv traps on LONG_MIN / -1, negate instead
+  if (__builtin_expect(b == -1, 0))
+    return arith_sub(0, a, result);
+  *result = a / b;
+  return VALID;
+}
+
+static inline int arith_mod(long int a, long int b, long int *result) {
+  if (__builtin_expect(b == 0, 0))
+    return DIVISION_BY_ZERO;
+  // Anything mod -1 is 0, and LONG_MIN % -1 would trap in idiv
+  *result = __builtin_expect(b == -1, 0) ? 0 : a % b;
+  return VALID;
+}
+
+// A constant divisor other than 0 and -1 can neither fail nor overflow, the
+// engines drop the checks for it when they compile
+static inline bool arith_safe_divisor(long int b) { return b != 0 && b != -1; }
+
+static inline int arith_abs(long int a, long int *result) {
+  if (__builtin_expect(a == LONG_MIN, 0))
+    return ARITHMETIC_OVERFLOW;
+  *result = labs(a);
+  return VALID;
+}
+
+/**
+ * @brief Raises base to exponent exactly, by squaring.
+ *
+ * Negative exponents give 1 / base^-exponent truncated toward zero like
+ * '/', which is 0 unless base is 1 or -1.
+ *
+ * @param result Receives the power when VALID is returned.
+ * @return int VALID, ARITHMETIC_OVERFLOW if the power does not fit in a
+ *             long int, or DIVISION_BY_ZERO for 0 to a negative power.
+ */
+int arith_pow(long int base, long int exponent, long int *result);
+
+#endif
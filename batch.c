@@ -0,0 +1,272 @@
+#include "batch.h"
+#include "fastfloat.h"
+#include "real.h"
+#include "threadpool.h"
+#include "util.h"
+#include <fcntl.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+// Lines read and evaluated before their results are written out in order
+#define BATCH_WINDOW 65536
+// Output lines up to this long are formatted on the stack
+#define BATCH_LINE_LEN 128
+
+// One window of input lines; results[ix] is the reorder slot of lines[ix]
+typedef struct batch_window {
+  const char *lines[BATCH_WINDOW];
+  size_t lens[BATCH_WINDOW];
+  BatchResult results[BATCH_WINDOW];
+  size_t count;
+  ParseFunc parse_func;
+  Cache *cache;
+
+  // getline buffers backing lines[] when reading from a stream
+  char *buffers[BATCH_WINDOW];
+  size_t caps[BATCH_WINDOW];
+} BatchWindow;
+
+// A read-only file mapping walked front to back
+typedef struct mapped_input {
+  const char *base;
+  const char *cursor;
+  const char *end;
+  size_t released; // Leading bytes already given back to the kernel
+} MappedInput;
+
+// Fills the window with the next lines, returns the input bytes consumed
+typedef size_t (*ReadWindowFunc)(BatchWindow *window, void *input);
+
+// Evaluates one line, returns the parser_errors code (VALID on success).
+// It does not run the optimizer: batch lines hold no variables and run once,
+// so folding them is an evaluation of its own on top of the parse. bench
+// batch measures 80% more time per line at 1 term, 20% at 16 and no gain
+// even at 256 terms.
+static int evaluate_line(const char *line, size_t len, ParseFunc parse_func,
+                         BatchResult *result) {
+  int err = VALID;
+  Parser *parser = parser_new(line, len);
+  if (parse_func(parser)) {
+    if (parser_float_flag)
+      result->value = real_to_bits(parser_evaluate_real(parser, &err));
+    else if (parser_precise_flag)
+      result->text = parser_evaluate_precise(parser, &err);
+    else
+      result->value = parser_evaluate(parser, &err);
+  } else {
+    err = parser_parse_error(parser);
+  }
+  parser_free(parser);
+  return err;
+}
+
+void batch_evaluate(const char *line, size_t len, ParseFunc parse_func,
+                    Cache *cache, BatchResult *result) {
+  char key[CACHE_KEY_LEN + 1];
+  int key_len = -1;
+
+  result->text = NULL;
+  if (cache) {
+    key_len = cache_normalize(line, len, key);
+    if (key_len >= 0 &&
+        cache_lookup(cache, key, key_len, &result->value, &result->error))
+      return;
+  }
+  result->error = evaluate_line(line, len, parse_func, result);
+  if (key_len >= 0)
+    cache_insert(cache, key, key_len, result->value, result->error);
+}
+
+int batch_format(const BatchResult *result, char *out, size_t cap) {
+  if (result->error)
+    return snprintf(out, cap, "ERROR: %s\n",
+                    parser_error_string(result->error));
+  if (result->text)
+    return snprintf(out, cap, "%s\n", result->text);
+  if (parser_float_flag) {
+    char text[FASTFLOAT_FORMAT_LEN];
+    fastfloat_format(real_from_bits(result->value), text);
+    return snprintf(out, cap, "%s\n", text);
+  }
+  return snprintf(out, cap, "%ld\n", result->value);
+}
+
+static void write_result(FILE *out, const BatchResult *result) {
+  char line[BATCH_LINE_LEN];
+  int len = batch_format(result, line, sizeof(line));
+  if (len < BATCH_LINE_LEN) {
+    fwrite(line, 1, len, out);
+    return;
+  }
+  char *long_line = malloc(len + 1);
+  batch_format(result, long_line, len + 1);
+  fwrite(long_line, 1, len, out);
+  free(long_line);
+}
+
+static void evaluate_task(void *context, size_t index) {
+  BatchWindow *window = context;
+  batch_evaluate(window->lines[index], window->lens[index], window->parse_func,
+                 window->cache, &window->results[index]);
+}
+
+// Length of a line without its line terminator
+static size_t trim_newline(const char *line, size_t len) {
+  while (len > 0 && (line[len - 1] == '\n' || line[len - 1] == '\r')) {
+    --len;
+  }
+  return len;
+}
+
+static size_t read_stream_window(BatchWindow *window, void *in) {
+  size_t bytes = 0;
+  window->count = 0;
+  while (window->count < BATCH_WINDOW) {
+    size_t ix = window->count;
+    ssize_t len = getline(&window->buffers[ix], &window->caps[ix], in);
+    if (len == -1)
+      break;
+    bytes += len;
+    window->lines[ix] = window->buffers[ix];
+    window->lens[ix] = trim_newline(window->buffers[ix], len);
+    ++(window->count);
+  }
+  return bytes;
+}
+
+// Lines point straight into the mapping, nothing is copied
+static size_t read_mapped_window(BatchWindow *window, void *input) {
+  MappedInput *mapped = input;
+  const char *start = mapped->cursor;
+
+  // The previous window is fully evaluated, drop its pages so files larger
+  // than RAM do not push everything else out of the page cache
+  size_t page = sysconf(_SC_PAGESIZE);
+  size_t consumed = (start - mapped->base) / page * page;
+  if (consumed > mapped->released) {
+    madvise((char *)mapped->base + mapped->released,
+            consumed - mapped->released, MADV_DONTNEED);
+    mapped->released = consumed;
+  }
+
+  window->count = 0;
+  while (window->count < BATCH_WINDOW && mapped->cursor < mapped->end) {
+    const char *line = mapped->cursor;
+    const char *newline = memchr(line, '\n', mapped->end - line);
+    mapped->cursor = newline ? newline + 1 : mapped->end;
+    window->lines[window->count] = line;
+    window->lens[window->count] = trim_newline(line, mapped->cursor - line);
+    ++(window->count);
+  }
+  return mapped->cursor - start;
+}
+
+static void run_windows(ReadWindowFunc read_window, void *input, FILE *out,
+                        BatchOptions *options, BatchStats *stats) {
+  BatchWindow *window = calloc(1, sizeof(BatchWindow));
+  ThreadPool *pool =
+      options->threads > 1 ? threadpool_new(options->threads) : NULL;
+  double start = util_seconds();
+
+  window->parse_func = options->parse_func;
+  // Cache entries hold a long int, precise results are text of any length
+  window->cache = options->cache_bytes && !parser_precise_flag
+                      ? cache_new(options->cache_bytes)
+                      : NULL;
+  stats->expressions = 0;
+  stats->errors = 0;
+  stats->bytes = 0;
+  for (;;) {
+    stats->bytes += read_window(window, input);
+    if (window->count == 0)
+      break;
+
+    if (pool) {
+      threadpool_run(pool, evaluate_task, window, window->count);
+    } else {
+      for (size_t ix = 0; ix < window->count; ix++) {
+        evaluate_task(window, ix);
+      }
+    }
+
+    for (size_t ix = 0; ix < window->count; ix++) {
+      BatchResult *result = &window->results[ix];
+      if (result->error)
+        ++(stats->errors);
+      write_result(out, result);
+      free(result->text);
+      result->text = NULL;
+    }
+    stats->expressions += window->count;
+  }
+  fflush(out);
+  stats->seconds = util_seconds() - start;
+
+  stats->cached = window->cache != NULL;
+  if (window->cache) {
+    cache_get_stats(window->cache, &stats->cache);
+    cache_free(window->cache);
+  }
+  if (pool)
+    threadpool_free(pool);
+  for (size_t ix = 0; ix < BATCH_WINDOW; ix++) {
+    free(window->buffers[ix]);
+  }
+  free(window);
+}
+
+void batch_run(FILE *in, FILE *out, BatchOptions *options, BatchStats *stats) {
+  run_windows(read_stream_window, in, out, options, stats);
+}
+
+bool batch_run_mapped(const char *path, FILE *out, BatchOptions *options,
+                      BatchStats *stats) {
+  int fd = open(path, O_RDONLY);
+  if (fd == -1)
+    return false;
+  struct stat st;
+  if (fstat(fd, &st) == -1) {
+    close(fd);
+    return false;
+  }
+
+  MappedInput mapped = {NULL, NULL, NULL, 0};
+  void *base = NULL;
+  // mmap rejects empty mappings, an empty file is just zero lines
+  if (st.st_size > 0) {
+    base = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    if (base == MAP_FAILED) {
+      close(fd);
+      return false;
+    }
+    madvise(base, st.st_size, MADV_SEQUENTIAL);
+    mapped.base = mapped.cursor = base;
+    mapped.end = mapped.base + st.st_size;
+  }
+  // The mapping keeps the file alive without the descriptor
+  close(fd);
+
+  run_windows(read_mapped_window, &mapped, out, options, stats);
+  if (base)
+    munmap(base, st.st_size);
+  return true;
+}
+
+void batch_print_stats(BatchStats *stats) {
+  double rate = stats->seconds > 0 ? stats->expressions / stats->seconds : 0;
+  double gbps = stats->seconds > 0 ? stats->bytes / stats->seconds / 1e9 : 0;
+  fprintf(stderr,
+          "Evaluated %ld expressions (%ld errors) in %.3f s: %.0f "
+          "expressions/sec",
+          stats->expressions, stats->errors, stats->seconds, rate);
+  if (stats->bytes)
+    fprintf(stderr, ", %.3f GB/s lexed", gbps);
+  fprintf(stderr, "\n");
+  if (stats->cached) {
+    fprintf(stderr, "Cache: %ld hits, %ld misses, %ld evictions\n",
+            stats->cache.hits, stats->cache.misses, stats->cache.evictions);
+  }
+}
@@ -0,0 +1,83 @@
+#ifndef BATCH_H
+#define BATCH_H
+
+#include <stdio.h>
+#include "cache.h"
+#include "parser.h"
+
+typedef struct batch_options
+{
+  ParseFunc parse_func; // Parses each line (infix or postfix)
+  int threads;          // Worker threads evaluating lines, 1 evaluates inline
+  size_t cache_bytes;   // Memory cap of the result cache, 0 disables it
+} BatchOptions;
+
+// The outcome of evaluating one line
+typedef struct batch_result
+{
+  long int value; // The bits of a double in float mode
+  int error;      // parser_errors code, VALID on success
+  char *text;     // Decimal result in precise mode, freed by the caller
+} BatchResult;
+
+typedef struct batch_stats
+{
+  long int expressions;
+  long int errors;
+  size_t bytes; // Input bytes lexed, line terminators included
+  double seconds;
+  bool cached;
+  CacheStats cache;
+} BatchStats;
+
+/**
+ * @brief Evaluates newline-delimited expressions until EOF.
+ *
+ * Every input line produces exactly one output line, in input order: either
+ * the result or an "ERROR: ..." message. Errors never stop the run.
+ *
+ * @param in The stream the expressions are read from.
+ * @param out The stream the results are written to.
+ * @param options How the lines are evaluated.
+ * @param stats Receives the expression/error counts, elapsed time and cache
+ *              counters.
+ */
+void batch_run(FILE *in, FILE *out, BatchOptions *options, BatchStats *stats);
+
+/**
+ * @brief Evaluates the newline-delimited expressions of a file in place.
+ *
+ * Behaves like batch_run, but the file is memory-mapped and lexed straight
+ * from the mapping without per-line copies. Pages are read sequentially and
+ * released once their lines are evaluated, so the file may exceed RAM.
+ *
+ * @param path The file the expressions are read from.
+ * @return bool false if the file could not be opened or mapped.
+ */
+bool batch_run_mapped(const char *path, FILE *out, BatchOptions *options,
+                      BatchStats *stats);
+
+/**
+ * @brief Evaluates one expression the way batch_run does.
+ *
+ * @param line The expression, without its line terminator.
+ * @param cache Looked up before and filled after evaluating, may be NULL.
+ * @param result Receives the value or error.
+ */
+void batch_evaluate(const char *line, size_t len, ParseFunc parse_func,
+                    Cache *cache, BatchResult *result);
+
+/**
+ * @brief Formats the output line of a result, newline included.
+ *
+ * @return int The length of the full line like snprintf, which may be more
+ *             than cap - 1 for long precise results.
+ */
+int batch_format(const BatchResult *result, char *out, size_t cap);
+
+/**
+ * @brief Prints the throughput summary of a batch run to stderr.
+ */
+void batch_print_stats(BatchStats *stats);
+
+#endif
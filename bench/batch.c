@@ -0,0 +1,64 @@
+#include "bench.h"
+#include "parser.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define LINES 20000
+
+static const int term_counts[] = {1, 2, 4, 8, 16, 64, 256};
+#define SIZE_COUNT ((int)(sizeof(term_counts) / sizeof(int)))
+
+// A batch line of terms constants joined by random operators, the shape of
+// batch input, which has no variables
+static char *generate(int terms) {
+  static const char *operators[] = {" + ", " - ", " * ", " % "};
+  char *text = malloc(terms * 16 + 1);
+  int at = 0;
+  for (int ix = 0; ix < terms; ix++) {
+    if (ix > 0)
+      at += sprintf(text + at, "%s", operators[rand() % 4]);
+    at += sprintf(text + at, "%d", rand() % 97 + 2);
+  }
+  return text;
+}
+
+// Nanoseconds per line to parse and evaluate, optimizing in between or not
+static double per_line(char **lines, int optimize, int *instructions) {
+  long int sum = 0;
+  double start = bench_seconds();
+  for (int ix = 0; ix < LINES; ix++) {
+    int err = 0;
+    Parser *parser = parser_new(lines[ix], strlen(lines[ix]));
+    parser_parse_infix(parser);
+    if (optimize)
+      parser_optimize(parser);
+    parser_instructions(parser, instructions);
+    sum += parser_evaluate(parser, &err);
+    parser_free(parser);
+  }
+  double elapsed = bench_seconds() - start;
+  bench_sink = sum;
+  return elapsed * 1e9 / LINES;
+}
+
+void bench_batch() {
+  srand(LINES);
+  printf("%d lines per row, ns/line parsed and evaluated once\n", LINES);
+  printf("%6s %12s %12s %12s %9s\n", "terms", "instructions", "plain",
+         "optimized", "change");
+  char **lines = malloc(LINES * sizeof(char *));
+  for (int size = 0; size < SIZE_COUNT; size++) {
+    for (int ix = 0; ix < LINES; ix++)
+      lines[ix] = generate(term_counts[size]);
+    int plain_len, optimized_len;
+    double plain = per_line(lines, 0, &plain_len);
+    double optimized = per_line(lines, 1, &optimized_len);
+    printf("%6d %5d -> %-4d %12.1f %12.1f %8.1f%%\n", term_counts[size],
+           plain_len, optimized_len, plain, optimized,
+           (optimized / plain - 1) * 100);
+    for (int ix = 0; ix < LINES; ix++)
+      free(lines[ix]);
+  }
+  free(lines);
+}
@@ -0,0 +1,100 @@
+#include "bench.h"
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+typedef struct benchmark {
+  const char *name;
+  const char *description;
+  void (*run)();
+} Benchmark;
+
+static const Benchmark benchmarks[] = {
+    {"stack", "Stack against the linked list it replaced", bench_stack},
+    {"threads", "Batch throughput by -j thread count", bench_threads},
+    {"program", "Compile once against parsing every time", bench_program},
+    {"engines", "Stack, threaded and JIT engines on one Program",
+     bench_engines},
+    {"nesting", "Recursive and iterative parsers by nesting depth",
+     bench_nesting},
+    {"keywords", "Builtin lookup by linear scan and perfect hash",
+     bench_keywords},
+    {"scan", "Lexer run scanning in MB/s, vector against scalar", bench_scan},
+    {"pow", "Exact integer '^' against the libm pow() it replaced", bench_pow},
+    {"checked", "Cost of checked arithmetic on each engine", bench_checked},
+    {"bignum", "-P multiplication and powers by operand size", bench_bignum},
+    {"batch", "Batch lines with and without the optimizer", bench_batch},
+};
+#define BENCHMARK_COUNT ((int)(sizeof(benchmarks) / sizeof(Benchmark)))
+
+volatile long int bench_sink;
+
+double bench_seconds() {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+#if defined(__GLIBC__)
+// glibc lets a program replace its allocator, these count the calls and
+// hand them on to the real one
+extern void *__libc_malloc(size_t size);
+extern void *__libc_calloc(size_t count, size_t size);
+extern void *__libc_realloc(void *ptr, size_t size);
+
+static long int allocations = 0;
+
+void *malloc(size_t size) {
+  __atomic_add_fetch(&allocations, 1, __ATOMIC_RELAXED);
+  return __libc_malloc(size);
+}
+
+void *calloc(size_t count, size_t size) {
+  __atomic_add_fetch(&allocations, 1, __ATOMIC_RELAXED);
+  return __libc_calloc(count, size);
+}
+
+void *realloc(void *ptr, size_t size) {
+  __atomic_add_fetch(&allocations, 1, __ATOMIC_RELAXED);
+  return __libc_realloc(ptr, size);
+}
+
+long int bench_allocations() {
+  return __atomic_load_n(&allocations, __ATOMIC_RELAXED);
+}
+#else
+long int bench_allocations() { return -1; }
+#endif
+
+int main(int argc, char *argv[]) {
+  for (int ix = 1; ix < argc; ix++) {
+    bool found = false;
+    for (int bx = 0; bx < BENCHMARK_COUNT && !found; bx++) {
+      found = !strcmp(argv[ix], benchmarks[bx].name);
+    }
+    if (!found) {
+      fprintf(stderr, "Unknown benchmark %s, one of:\n", argv[ix]);
+      for (int bx = 0; bx < BENCHMARK_COUNT; bx++) {
+        fprintf(stderr, "  %-10s %s\n", benchmarks[bx].name,
+                benchmarks[bx].description);
+      }
+      return 1;
+    }
+  }
+
+  for (int bx = 0; bx < BENCHMARK_COUNT; bx++) {
+    bool selected = argc == 1;
+    for (int ix = 1; ix < argc && !selected; ix++) {
+      selected = !strcmp(argv[ix], benchmarks[bx].name);
+    }
+    if (!selected)
+      continue;
+    printf("== %s: %s\n", benchmarks[bx].name, benchmarks[bx].description);
+    benchmarks[bx].run();
+    printf("\n");
+    fflush(stdout);
+  }
+  return 0;
+}
@@ -0,0 +1,42 @@
+#ifndef BENCH_H
+#define BENCH_H
+
+#include <stddef.h>
+
+/*
+  Benchmarks of the library. `make bench` builds them together with the
+  library sources at -O2 and runs them all; `bench/bench name...` runs only
+  the named ones. Each prints a table of its measurements to stdout.
+*/
+
+// Results are stored here so the work being measured is not optimized out
+extern volatile long int bench_sink;
+
+/**
+ * @brief Reads a monotonic clock.
+ *
+ * @return double The time in seconds.
+ */
+double bench_seconds();
+
+/**
+ * @brief Counts the malloc, calloc and realloc calls made so far by every
+ *        thread.
+ *
+ * @return long int The count, or -1 where the C library cannot be counted.
+ */
+long int bench_allocations();
+
+void bench_stack();
+void bench_threads();
+void bench_program();
+void bench_engines();
+void bench_nesting();
+void bench_keywords();
+void bench_scan();
+void bench_pow();
+void bench_checked();
+void bench_bignum();
+void bench_batch();
+
+#endif
@@ -0,0 +1,100 @@
+#include "bench.h"
+#include "bignum.h"
+#include <math.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#define RUN_SECONDS 0.2
+
+static const int sizes[] = {1000, 10000, 100000};
+#define SIZE_COUNT ((int)(sizeof(sizes) / sizeof(int)))
+
+// Schoolbook only, then Karatsuba from each threshold up
+static const size_t thresholds[] = {SIZE_MAX, 8, 16, 32, 64, 128};
+#define THRESHOLD_COUNT ((int)(sizeof(thresholds) / sizeof(size_t)))
+
+static BigNum *random_number(int digits) {
+  char *text = malloc(digits);
+  text[0] = '1' + random() % 9;
+  for (int ix = 1; ix < digits; ix++)
+    text[ix] = '0' + random() % 10;
+  BigNum *num = bignum_from_decimal(text, digits);
+  free(text);
+  return num;
+}
+
+// Milliseconds per product of two digits-long numbers
+static double time_mul(const BigNum *a, const BigNum *b) {
+  long int runs = 0;
+  double start = bench_seconds(), elapsed;
+  do {
+    BigNum *product = bignum_mul(a, b);
+    bench_sink = bignum_sign(product);
+    bignum_free(product);
+    runs++;
+  } while ((elapsed = bench_seconds() - start) < RUN_SECONDS);
+  return elapsed * 1e3 / runs;
+}
+
+// Milliseconds for 7 to the power with about digits digits
+static double time_pow(int digits) {
+  BigNum *seven = bignum_from_long(7);
+  unsigned long int exponent = (unsigned long int)(digits / log10(7.0));
+  long int runs = 0;
+  double start = bench_seconds(), elapsed;
+  do {
+    BigNum *power = bignum_pow(seven, exponent);
+    bench_sink = bignum_sign(power);
+    bignum_free(power);
+    runs++;
+  } while ((elapsed = bench_seconds() - start) < RUN_SECONDS);
+  bignum_free(seven);
+  return elapsed * 1e3 / runs;
+}
+
+static void print_threshold(size_t threshold) {
+  if (threshold == SIZE_MAX)
+    printf("%-16s", "schoolbook");
+  else
+    printf("karatsuba >= %-3zu", threshold);
+}
+
+void bench_bignum() {
+  srandom(1);
+  BigNum *as[SIZE_COUNT], *bs[SIZE_COUNT];
+  for (int sx = 0; sx < SIZE_COUNT; sx++) {
+    as[sx] = random_number(sizes[sx]);
+    bs[sx] = random_number(sizes[sx]);
+  }
+
+  printf("ms per a * b, both operands of the given digits\n%-16s", "");
+  for (int sx = 0; sx < SIZE_COUNT; sx++)
+    printf(" %10d", sizes[sx]);
+  printf("\n");
+  for (int tx = 0; tx < THRESHOLD_COUNT; tx++) {
+    bignum_karatsuba_threshold = thresholds[tx];
+    print_threshold(thresholds[tx]);
+    for (int sx = 0; sx < SIZE_COUNT; sx++)
+      printf(" %10.3f", time_mul(as[sx], bs[sx]));
+    printf("\n");
+  }
+
+  printf("ms per 7 ^ n with about the given digits\n%-16s", "");
+  for (int sx = 0; sx < SIZE_COUNT; sx++)
+    printf(" %10d", sizes[sx]);
+  printf("\n");
+  for (int tx = 0; tx < THRESHOLD_COUNT; tx++) {
+    bignum_karatsuba_threshold = thresholds[tx];
+    print_threshold(thresholds[tx]);
+    for (int sx = 0; sx < SIZE_COUNT; sx++)
+      printf(" %10.3f", time_pow(sizes[sx]));
+    printf("\n");
+  }
+  bignum_karatsuba_threshold = KARATSUBA_THRESHOLD;
+
+  for (int sx = 0; sx < SIZE_COUNT; sx++) {
+    bignum_free(as[sx]);
+    bignum_free(bs[sx]);
+  }
+}
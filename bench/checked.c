@@ -0,0 +1,72 @@
+#include "bench.h"
+#include "parser.h"
+#include "program.h"
+#include <stdio.h>
+#include <stdlib.h>
+
+#define RUN_SECONDS 0.1
+#define ROUNDS 7
+#define TERMS 256
+
+static const char *engines[] = {"stack", "threaded", "jit"};
+
+// Products, quotients and remainders of x and small numbers added up, none
+// of which overflows or divides by zero for x = 3, so both modes do the same
+// work
+static char *generate() {
+  static const char *operators[] = {"*", "/", "%"};
+  char *text = malloc(TERMS * 16 + 1);
+  int at = 0;
+  srand(TERMS);
+  for (int ix = 0; ix < TERMS; ix++) {
+    if (ix > 0)
+      at += sprintf(text + at, "%s", rand() % 2 ? " + " : " - ");
+    at += sprintf(text + at, "x %s %d", operators[rand() % 3], rand() % 9 + 2);
+  }
+  return text;
+}
+
+static Program *compile(char *text, int checked) {
+  int err = 0;
+  parser_checked_flag = checked;
+  Program *program = program_compile(text, parser_parse_infix, &err);
+  parser_checked_flag = 0;
+  return program;
+}
+
+static double rate(Program *program) {
+  int err = 0;
+  long int x = 3, sum = 0, runs = 0;
+  double start = bench_seconds(), elapsed;
+  do {
+    for (int ix = 0; ix < 1000; ix++)
+      sum += program_evaluate(program, &x, &err);
+    runs += 1000;
+  } while ((elapsed = bench_seconds() - start) < RUN_SECONDS);
+  bench_sink = sum + err;
+  return elapsed * 1e9 / runs;
+}
+
+void bench_checked() {
+  char *text = generate();
+  printf("%d terms of x * / %% a constant, ns/evaluation\n", TERMS);
+  printf("%-9s %10s %10s %9s\n", "", "unchecked", "checked", "overhead");
+  for (int engine = 0; engine < 3; engine++) {
+    parser_set_engine(engines[engine]);
+    Program *plain = compile(text, 0), *checked = compile(text, 1);
+    // The best of interleaved rounds, so drift hits both modes alike
+    double best_plain = 0, best_checked = 0;
+    for (int round = 0; round < ROUNDS; round++) {
+      double ns = rate(plain);
+      best_plain = round == 0 || ns < best_plain ? ns : best_plain;
+      ns = rate(checked);
+      best_checked = round == 0 || ns < best_checked ? ns : best_checked;
+    }
+    program_free(plain);
+    program_free(checked);
+    printf("%-9s %10.1f %10.1f %8.1f%%\n", engines[engine], best_plain,
+           best_checked, (best_checked / best_plain - 1) * 100);
+  }
+  parser_set_engine("stack");
+  free(text);
+}
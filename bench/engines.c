@@ -0,0 +1,81 @@
+#include "bench.h"
+#include "parser.h"
+#include "program.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define RUN_SECONDS 0.3
+
+static const char *engines[] = {"stack", "threaded", "jit"};
+
+// terms operands (x or a small number) joined by + - *. Wide expressions
+// are flat, deep ones nest to the right and keep every operand on the
+// stack until the end.
+static char *generate(int terms, bool deep) {
+  static const char operators[] = "+-*";
+  char *text = malloc(terms * 8 + 1);
+  int at = 0;
+  srand(terms);
+  for (int ix = 0; ix < terms; ix++) {
+    if (rand() % 2)
+      at += sprintf(text + at, "x");
+    else
+      at += sprintf(text + at, "%d", rand() % 9 + 2);
+    if (ix + 1 < terms)
+      at += sprintf(text + at, "%c%s", operators[rand() % 3], deep ? "(" : "");
+  }
+  for (int ix = 1; deep && ix < terms; ix++) {
+    text[at++] = ')';
+  }
+  text[at] = '\0';
+  return text;
+}
+
+// Length of the code program_compile makes of text
+static int instruction_count(char *text) {
+  int len;
+  Parser *parser = parser_new(text, strlen(text));
+  parser_parse_infix(parser);
+  parser_optimize(parser);
+  parser_instructions(parser, &len);
+  parser_free(parser);
+  return len;
+}
+
+static void measure(const char *shape, int terms, bool deep) {
+  char *text = generate(terms, deep);
+  int len = instruction_count(text);
+  double stack_rate = 0;
+  for (int engine = 0; engine < 3; engine++) {
+    parser_set_engine(engines[engine]);
+    int err = 0;
+    Program *program = program_compile(text, parser_parse_infix, &err);
+    long int x = 3, sum = 0, runs = 0;
+    double start = bench_seconds(), elapsed;
+    do {
+      for (int ix = 0; ix < 1000; ix++) {
+        sum += program_evaluate(program, &x, &err);
+      }
+      runs += 1000;
+    } while ((elapsed = bench_seconds() - start) < RUN_SECONDS);
+    bench_sink = sum;
+    program_free(program);
+
+    double rate = runs * len / elapsed;
+    if (engine == 0)
+      stack_rate = rate;
+    printf("%-5s %5d terms %5d instructions  %-9s %8.1f M instructions/sec "
+           "%6.2fx\n",
+           shape, terms, len, engines[engine], rate / 1e6, rate / stack_rate);
+  }
+  parser_set_engine("stack");
+  free(text);
+}
+
+void bench_engines() {
+  measure("wide", 16, false);
+  measure("wide", 1024, false);
+  measure("deep", 16, true);
+  measure("deep", 1024, true);
+}
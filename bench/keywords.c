@@ -0,0 +1,148 @@
+#include "bench.h"
+#include "lexer.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define LOOKUPS 10000000
+#define SLOTS 128
+
+// A builtin set the size a function library would grow to, abs is the only
+// one the lexer has today
+static const char *builtins[] = {
+    "abs",      "min",      "max",      "gcd",      "lcm",      "sqrt",
+    "cbrt",     "exp",      "exp2",     "expm1",    "log",      "log2",
+    "log10",    "log1p",    "sin",      "cos",      "tan",      "asin",
+    "acos",     "atan",     "atan2",    "sinh",     "cosh",     "tanh",
+    "asinh",    "acosh",    "atanh",    "floor",    "ceil",     "round",
+    "trunc",    "sign",     "pow",      "hypot",    "fmod",     "clamp",
+    "fact",     "choose",   "isqrt",    "ilog2",    "popcount", "clz",
+    "ctz",      "bswap",    "rotl",     "rotr",     "mean",     "median",
+    "sum",      "prod"};
+#define BUILTIN_COUNT ((int)(sizeof(builtins) / sizeof(builtins[0])))
+
+// Names that are not builtins, looked up as often as the builtins are
+static const char *misses[] = {"x",     "y",    "price", "qty",  "total",
+                               "a",     "rate", "count", "tmp1", "sums",
+                               "asins", "b",    "lo",    "hi",   "n"};
+#define MISS_COUNT ((int)(sizeof(misses) / sizeof(misses[0])))
+
+// The lexer's KEYWORD_HASH shape with the second character added, the
+// length, first and last characters alone give asin and atan one key
+#define HASH(len, name)                                                       \
+  (((len) * 36 + (unsigned char)(name)[0] * 29 +                              \
+    (unsigned char)(name)[(len) > 1] * 43 + (unsigned char)(name)[(len)-1]) & \
+   (SLOTS - 1))
+
+// Index of the builtin in each slot plus one, 0 for a free slot
+static int table[SLOTS];
+
+// The lexer before the keyword table: compare against every builtin in turn
+static int lookup_linear(const char *name, size_t len) {
+  for (int ix = 0; ix < BUILTIN_COUNT; ix++) {
+    if (strlen(builtins[ix]) == len && !strncmp(builtins[ix], name, len))
+      return ix;
+  }
+  return -1;
+}
+
+// One probe and one compare, as lookup_keyword does
+static int lookup_hash(const char *name, size_t len) {
+  int at = table[HASH(len, name)] - 1;
+  if (at >= 0 && strlen(builtins[at]) == len &&
+      !memcmp(builtins[at], name, len))
+    return at;
+  return -1;
+}
+
+static double time_lookups(int (*lookup)(const char *, size_t),
+                           const char **names, const size_t *lens,
+                           int count) {
+  long int sum = 0;
+  double start = bench_seconds();
+  for (long int ix = 0; ix < LOOKUPS; ix++) {
+    int at = ix % count;
+    sum += lookup(names[at], lens[at]);
+  }
+  double elapsed = bench_seconds() - start;
+  bench_sink = sum;
+  return elapsed * 1e9 / LOOKUPS;
+}
+
+// Keys of the lexer's own hash that more than one builtin shares
+static int shared_keys() {
+  int shared = 0;
+  for (int ix = 0; ix < BUILTIN_COUNT; ix++) {
+    const char *name = builtins[ix];
+    size_t len = strlen(name);
+    for (int jx = 0; jx < ix; jx++) {
+      const char *other = builtins[jx];
+      if (strlen(other) == len && other[0] == name[0] &&
+          other[len - 1] == name[len - 1]) {
+        shared++;
+        break;
+      }
+    }
+  }
+  return shared;
+}
+
+// Lexes a name heavy formula over and over
+static double time_lexer(long int *tokens) {
+  const char formula[] = "abs(price - qty) * rate + abs(x) % total - y ^ 2 ";
+  size_t len = strlen(formula);
+  int copies = 100000;
+  char *text = malloc(len * copies);
+  for (int ix = 0; ix < copies; ix++)
+    memcpy(text + ix * len, formula, len);
+
+  *tokens = 0;
+  double start = bench_seconds();
+  Lexer *lexer = lexer_new(text, len * copies);
+  do {
+    lexer_advance_token(lexer);
+    (*tokens)++;
+  } while (lexer_get_token(lexer)->type != end);
+  lexer_free(lexer);
+  double elapsed = bench_seconds() - start;
+  free(text);
+  return elapsed * 1e9 / *tokens;
+}
+
+void bench_keywords() {
+  int clashes = 0;
+  for (int ix = 0; ix < BUILTIN_COUNT; ix++) {
+    size_t len = strlen(builtins[ix]);
+    int *slot = &table[HASH(len, builtins[ix])];
+    clashes += *slot != 0;
+    *slot = ix + 1;
+  }
+  printf("%d builtins in %d slots, %d clashes; %d share a key of the lexer's "
+         "hash\n",
+         BUILTIN_COUNT, SLOTS, clashes, shared_keys());
+
+  const char *hits[BUILTIN_COUNT], *mixed[BUILTIN_COUNT + MISS_COUNT];
+  size_t hit_lens[BUILTIN_COUNT], mixed_lens[BUILTIN_COUNT + MISS_COUNT];
+  for (int ix = 0; ix < BUILTIN_COUNT; ix++) {
+    hits[ix] = mixed[ix] = builtins[ix];
+    hit_lens[ix] = mixed_lens[ix] = strlen(builtins[ix]);
+  }
+  for (int ix = 0; ix < MISS_COUNT; ix++) {
+    mixed[BUILTIN_COUNT + ix] = misses[ix];
+    mixed_lens[BUILTIN_COUNT + ix] = strlen(misses[ix]);
+  }
+
+  printf("%-20s %12s %12s\n", "", "linear", "hash");
+  double linear = time_lookups(lookup_linear, hits, hit_lens, BUILTIN_COUNT);
+  double hash = time_lookups(lookup_hash, hits, hit_lens, BUILTIN_COUNT);
+  printf("%-20s %9.1f ns %9.1f ns\n", "builtins", linear, hash);
+  int count = BUILTIN_COUNT + MISS_COUNT;
+  linear = time_lookups(lookup_linear, mixed, mixed_lens, count);
+  hash = time_lookups(lookup_hash, mixed, mixed_lens, count);
+  printf("%-20s %9.1f ns %9.1f ns\n", "builtins and names", linear, hash);
+
+  long int tokens;
+  double per_token = time_lexer(&tokens);
+  printf("lexer, name heavy formula: %.1f ns/token over %ld tokens\n",
+         per_token, tokens);
+}
@@ -0,0 +1,70 @@
+#include "bench.h"
+#include "parser.h"
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/resource.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+// "(1+(1+ ... 1))" nested depth times
+static char *nested(int depth, size_t *len) {
+  char *text = malloc(depth * 4 + 2);
+  size_t at = 0;
+  for (int ix = 0; ix < depth; ix++) {
+    memcpy(text + at, "(1+", 3);
+    at += 3;
+  }
+  text[at++] = '1';
+  memset(text + at, ')', depth);
+  at += depth;
+  text[at] = '\0';
+  *len = at;
+  return text;
+}
+
+// Parses in a child process, so its peak memory can be read on its own and
+// a parse that overflows the C stack only ends the child
+static void measure(const char *name, ParseFunc parse_func, int depth) {
+  int fds[2];
+  if (pipe(fds) == -1)
+    return;
+  pid_t pid = fork();
+  if (pid == 0) {
+    size_t len;
+    char *text = nested(depth, &len);
+    double start = bench_seconds();
+    Parser *parser = parser_new(text, len);
+    bool valid = parse_func(parser);
+    double elapsed = valid ? bench_seconds() - start : -1;
+    if (write(fds[1], &elapsed, sizeof(elapsed)) != sizeof(elapsed))
+      _exit(1);
+    _exit(0);
+  }
+  close(fds[1]);
+  double elapsed = -1;
+  int status;
+  struct rusage usage;
+  if (read(fds[0], &elapsed, sizeof(elapsed)) != sizeof(elapsed))
+    elapsed = -1;
+  close(fds[0]);
+  wait4(pid, &status, 0, &usage);
+
+  printf("%-9s depth %8d ", name, depth);
+  if (WIFSIGNALED(status))
+    printf("crashed with signal %d (%s)\n", WTERMSIG(status),
+           strsignal(WTERMSIG(status)));
+  else if (elapsed < 0)
+    printf("failed to parse\n");
+  else
+    printf("%10.3f ms %8.1f MiB peak\n", elapsed * 1e3,
+           usage.ru_maxrss / 1024.0);
+}
+
+void bench_nesting() {
+  for (int depth = 10; depth <= 1000000; depth *= 10) {
+    measure("recursive", parser_parse_infix, depth);
+    measure("iterative", parser_parse_infix_iterative, depth);
+  }
+}
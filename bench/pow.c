@@ -0,0 +1,93 @@
+#include "arith.h"
+#include "bench.h"
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#define PAIRS 1000000
+#define PASSES 10
+
+// The kernel '^' used before arith_pow, a round trip through double
+static long int libm_pow(long int base, long int exponent) {
+  return (long int)pow((double)base, (double)exponent);
+}
+
+// Largest base whose exponent-th power fits in a long int
+static long int max_base(long int exponent) {
+  long int base = (long int)pow((double)LONG_MAX, 1.0 / exponent) + 1;
+  long int result;
+  while (arith_pow(base, exponent, &result) != VALID)
+    base--;
+  return base;
+}
+
+static long int random_between(long int low, long int high) {
+  return low + (long int)(random() % (high - low + 1));
+}
+
+static void measure(const char *name, const long int *bases,
+                    const long int *exponents) {
+  long int sum = 0;
+  double start = bench_seconds();
+  for (int pass = 0; pass < PASSES; pass++) {
+    for (int ix = 0; ix < PAIRS; ix++) {
+      long int result = 0;
+      arith_pow(bases[ix], exponents[ix], &result);
+      sum += result;
+    }
+  }
+  double exact = bench_seconds() - start;
+
+  start = bench_seconds();
+  for (int pass = 0; pass < PASSES; pass++) {
+    for (int ix = 0; ix < PAIRS; ix++)
+      sum += libm_pow(bases[ix], exponents[ix]);
+  }
+  double libm = bench_seconds() - start;
+  bench_sink = sum;
+
+  // Results pow() gets wrong among the ones that fit
+  long int wrong = 0;
+  for (int ix = 0; ix < PAIRS; ix++) {
+    long int result;
+    if (arith_pow(bases[ix], exponents[ix], &result) == VALID &&
+        result != libm_pow(bases[ix], exponents[ix]))
+      wrong++;
+  }
+  double count = (double)PAIRS * PASSES;
+  printf("%-24s %8.1f ns %8.1f ns %7.2fx %11ld\n", name, exact * 1e9 / count,
+         libm * 1e9 / count, libm / exact, wrong);
+}
+
+void bench_pow() {
+  long int *bases = malloc(PAIRS * sizeof(long int));
+  long int *exponents = malloc(PAIRS * sizeof(long int));
+  srandom(1);
+  printf("%d random pairs per row, %d passes\n", PAIRS, PASSES);
+  printf("%-24s %11s %11s %8s %11s\n", "", "arith_pow", "pow()", "speedup",
+         "pow() wrong");
+
+  for (int ix = 0; ix < PAIRS; ix++) {
+    bases[ix] = random_between(-1000, 1000);
+    exponents[ix] = random_between(0, 2);
+  }
+  measure("exponent 0-2", bases, exponents);
+
+  // Every power fits, the loop runs for exponents past 2
+  for (int ix = 0; ix < PAIRS; ix++) {
+    exponents[ix] = random_between(3, 62);
+    long int high = max_base(exponents[ix]);
+    bases[ix] = random_between(-high, high);
+  }
+  measure("exponent 3-62, fits", bases, exponents);
+
+  // Mostly overflows, which arith_pow reports and pow() saturates
+  for (int ix = 0; ix < PAIRS; ix++) {
+    bases[ix] = random_between(-1000000, 1000000);
+    exponents[ix] = random_between(0, 100);
+  }
+  measure("any base, exponent 0-100", bases, exponents);
+
+  free(bases);
+  free(exponents);
+}
@@ -0,0 +1,62 @@
+#include "bench.h"
+#include "parser.h"
+#include "program.h"
+#include <stdio.h>
+#include <string.h>
+
+#define EVALUATIONS 1000000
+
+static const char *engines[] = {"stack", "threaded", "jit"};
+
+// Text of the formula with its bindings written in as literals
+static int format(char *out, size_t cap, long int price, long int qty) {
+  return snprintf(out, cap, "(%ld * %ld) %% 7 + abs(%ld - %ld * 3) ^ 2",
+                  price, qty, price, qty);
+}
+
+void bench_program() {
+  char formula[] = "(price * qty) % 7 + abs(price - qty * 3) ^ 2";
+  printf("%s, %d evaluations\n", formula, EVALUATIONS);
+
+  // Parsing every time: the bindings are substituted into the text
+  char text[128];
+  long int sum = 0;
+  double start = bench_seconds();
+  for (long int ix = 0; ix < EVALUATIONS; ix++) {
+    int len = format(text, sizeof(text), ix % 1000, ix % 37);
+    int err = 0;
+    Parser *parser = parser_new(text, len);
+    if (parser_parse_infix(parser)) {
+      parser_optimize(parser);
+      sum += parser_evaluate(parser, &err);
+    }
+    parser_free(parser);
+  }
+  double parse_each = bench_seconds() - start;
+  bench_sink = sum;
+  printf("%-24s %8.1f ns/evaluation %6.2fx\n", "parse every time",
+         parse_each * 1e9 / EVALUATIONS, 1.0);
+
+  for (int engine = 0; engine < 3; engine++) {
+    parser_set_engine(engines[engine]);
+    int err = 0;
+    start = bench_seconds();
+    Program *program = program_compile(formula, parser_parse_infix, &err);
+    int price = program_variable_index(program, "price");
+    int qty = program_variable_index(program, "qty");
+    long int values[2];
+    for (long int ix = 0; ix < EVALUATIONS; ix++) {
+      values[price] = ix % 1000;
+      values[qty] = ix % 37;
+      sum += program_evaluate(program, values, &err);
+    }
+    double elapsed = bench_seconds() - start;
+    program_free(program);
+    bench_sink = sum;
+    char label[32];
+    snprintf(label, sizeof(label), "compile once, %s", engines[engine]);
+    printf("%-24s %8.1f ns/evaluation %6.2fx\n", label,
+           elapsed * 1e9 / EVALUATIONS, parse_each / elapsed);
+  }
+  parser_set_engine("stack");
+}
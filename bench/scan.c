@@ -0,0 +1,119 @@
+#include "bench.h"
+#include "lexer.h"
+#include "scan.h"
+#include <ctype.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define BUFFER_SIZE (16 << 20)
+#define PASSES 8
+
+typedef const char *(*RunFunc)(const char *cp, const char *end);
+
+// The lexer before the scan module: a locale-aware ctype call per byte
+static const char *ctype_spaces(const char *cp, const char *end) {
+  while (cp < end && isspace((unsigned char)*cp))
+    ++cp;
+  return cp;
+}
+
+static const char *ctype_digits(const char *cp, const char *end) {
+  while (cp < end && isdigit((unsigned char)*cp))
+    ++cp;
+  return cp;
+}
+
+// The scalar fallback of the scan module, a class table lookup per byte
+static const char *table_spaces(const char *cp, const char *end) {
+  while (cp < end && (scan_class[(unsigned char)*cp] & CLASS_SPACE))
+    ++cp;
+  return cp;
+}
+
+static const char *table_digits(const char *cp, const char *end) {
+  while (cp < end && (scan_class[(unsigned char)*cp] & CLASS_DIGIT))
+    ++cp;
+  return cp;
+}
+
+// Runs of run bytes from chars, each followed by one '+'
+static void fill_runs(char *buffer, size_t size, int run, const char *chars) {
+  size_t count = strlen(chars);
+  for (size_t ix = 0; ix < size; ix++)
+    buffer[ix] = ix % (run + 1) == (size_t)run ? '+' : chars[ix % count];
+}
+
+// Megabytes per second through the buffer, skipping each run and its '+'
+static double throughput(RunFunc skip, const char *buffer, size_t size) {
+  const char *end = buffer + size;
+  long int runs = 0;
+  double start = bench_seconds();
+  for (int pass = 0; pass < PASSES; pass++) {
+    const char *cp = buffer;
+    while (cp < end) {
+      cp = skip(cp, end) + 1;
+      runs++;
+    }
+  }
+  double elapsed = bench_seconds() - start;
+  bench_sink = runs;
+  return size * (double)PASSES / elapsed / 1e6;
+}
+
+// Megabytes per second through the whole lexer
+static double lexer_throughput(const char *buffer, size_t size) {
+  long int tokens = 0;
+  double start = bench_seconds();
+  for (int pass = 0; pass < PASSES; pass++) {
+    Lexer *lexer = lexer_new(buffer, size);
+    do {
+      lexer_advance_token(lexer);
+      tokens++;
+    } while (lexer_get_token(lexer)->type != end);
+    lexer_free(lexer);
+  }
+  double elapsed = bench_seconds() - start;
+  bench_sink = tokens;
+  return size * (double)PASSES / elapsed / 1e6;
+}
+
+void bench_scan() {
+#if defined(__x86_64__)
+  printf("Vector path: %s\n", __builtin_cpu_supports("avx2") ? "AVX2" : "SSE2");
+#else
+  printf("Vector path: none, scalar only\n");
+#endif
+  char *buffer = malloc(BUFFER_SIZE);
+  static const int runs[] = {1, 4, 16, 64, 1024};
+
+  printf("%-12s %6s %10s %10s %10s\n", "MB/s", "run", "ctype", "table",
+         "scan");
+  for (int kind = 0; kind < 2; kind++) {
+    for (int rx = 0; rx < (int)(sizeof(runs) / sizeof(int)); rx++) {
+      fill_runs(buffer, BUFFER_SIZE, runs[rx], kind ? "0123456789" : "  \t ");
+      RunFunc ctype = kind ? ctype_digits : ctype_spaces;
+      RunFunc table = kind ? table_digits : table_spaces;
+      RunFunc scan = kind ? scan_digits : scan_spaces;
+      printf("%-12s %6d %10.0f %10.0f %10.0f\n", kind ? "digits" : "whitespace",
+             runs[rx], throughput(ctype, buffer, BUFFER_SIZE),
+             throughput(table, buffer, BUFFER_SIZE),
+             throughput(scan, buffer, BUFFER_SIZE));
+    }
+  }
+
+  // Indented formulas with long literals, the shape the vector path is for
+  static const char *inputs[][2] = {
+      {"short tokens", "x+1*y-2 "},
+      {"long runs", "        12345678901234 +          98765432109876 *    x "},
+  };
+  for (int ix = 0; ix < 2; ix++) {
+    size_t len = strlen(inputs[ix][1]);
+    size_t size = BUFFER_SIZE / len * len;
+    for (size_t at = 0; at < size; at += len)
+      memcpy(buffer + at, inputs[ix][1], len);
+    printf("lexer, %-12s %10.0f MB/s\n", inputs[ix][0],
+           lexer_throughput(buffer, size));
+  }
+  free(buffer);
+}
@@ -0,0 +1,169 @@
+#include "bench.h"
+#include "parser.h"
+#include "stack.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define EXPRESSIONS 256
+#define RUN_SECONDS 0.3
+
+// The Stack before it moved to a contiguous buffer: a node per value
+typedef struct list_node {
+  long int value;
+  struct list_node *next;
+} ListNode;
+
+typedef struct list_stack {
+  ListNode *entries;
+  size_t size;
+} ListStack;
+
+static ListStack *list_create() {
+  ListStack *stack = malloc(sizeof(ListStack));
+  stack->entries = NULL;
+  stack->size = 0;
+  return stack;
+}
+
+static void list_push(ListStack *stack, long int value) {
+  ListNode *node = malloc(sizeof(ListNode));
+  node->value = value;
+  node->next = stack->entries;
+  stack->entries = node;
+  ++(stack->size);
+}
+
+static long int list_pop(ListStack *stack) {
+  ListNode *top = stack->entries;
+  long int value = top->value;
+  stack->entries = top->next;
+  free(top);
+  --(stack->size);
+  return value;
+}
+
+static void list_free(ListStack *stack) {
+  while (stack->entries) {
+    list_pop(stack);
+  }
+  free(stack);
+}
+
+static long int combine(TokenType opcode, long int a, long int b) {
+  switch (opcode) {
+  case add:
+    return a + b;
+  case sub:
+    return a - b;
+  default:
+    return a * b;
+  }
+}
+
+// The evaluation loop parser_evaluate ran over each kind of stack
+static long int run_stack(const Instruction *code, int len) {
+  Stack *stack = stack_create();
+  int err = 0;
+  for (int ix = 0; ix < len; ix++) {
+    if (code[ix].opcode == number) {
+      stack_push(stack, code[ix].value);
+    } else {
+      long int b = stack_pop(stack, &err);
+      long int a = stack_pop(stack, &err);
+      stack_push(stack, combine(code[ix].opcode, a, b));
+    }
+  }
+  long int result = stack_pop(stack, &err);
+  stack_free(stack);
+  return result;
+}
+
+static long int run_list(const Instruction *code, int len) {
+  ListStack *stack = list_create();
+  for (int ix = 0; ix < len; ix++) {
+    if (code[ix].opcode == number) {
+      list_push(stack, code[ix].value);
+    } else {
+      long int b = list_pop(stack);
+      long int a = list_pop(stack);
+      list_push(stack, combine(code[ix].opcode, a, b));
+    }
+  }
+  long int result = list_pop(stack);
+  list_free(stack);
+  return result;
+}
+
+// Compiles terms operands joined by + - *. Wide expressions are flat and
+// keep two values on the stack, deep ones nest to the right and keep all of
+// them.
+static Instruction *compile(int terms, bool deep, unsigned int seed,
+                            int *len) {
+  static const char operators[] = "+-*";
+  char *text = malloc(terms * 8 + 1);
+  int at = 0;
+  srand(seed);
+  for (int ix = 0; ix < terms; ix++) {
+    at += sprintf(text + at, "%d", rand() % 9 + 1);
+    if (ix + 1 < terms)
+      at += sprintf(text + at, "%c%s", operators[rand() % 3], deep ? "(" : "");
+  }
+  for (int ix = 1; deep && ix < terms; ix++) {
+    text[at++] = ')';
+  }
+
+  Parser *parser = parser_new(text, at);
+  parser_parse_infix(parser);
+  const Instruction *parsed = parser_instructions(parser, len);
+  Instruction *code = malloc(*len * sizeof(Instruction));
+  memcpy(code, parsed, *len * sizeof(Instruction));
+  parser_free(parser);
+  free(text);
+  return code;
+}
+
+typedef long int (*RunFunc)(const Instruction *code, int len);
+
+static void measure(const char *shape, int terms, bool deep) {
+  Instruction *codes[EXPRESSIONS];
+  int lens[EXPRESSIONS];
+  for (int ix = 0; ix < EXPRESSIONS; ix++) {
+    codes[ix] = compile(terms, deep, ix + 1, &lens[ix]);
+  }
+
+  static const char *names[] = {"linked list", "contiguous"};
+  static const RunFunc runs[] = {run_list, run_stack};
+  for (int kind = 0; kind < 2; kind++) {
+    long int allocations = bench_allocations();
+    long int sum = 0;
+    for (int ix = 0; ix < EXPRESSIONS; ix++) {
+      sum += runs[kind](codes[ix], lens[ix]);
+    }
+    allocations = bench_allocations() - allocations;
+
+    long int ops = 0;
+    double start = bench_seconds(), elapsed;
+    do {
+      for (int ix = 0; ix < EXPRESSIONS; ix++) {
+        sum += runs[kind](codes[ix], lens[ix]);
+        ops += lens[ix];
+      }
+    } while ((elapsed = bench_seconds() - start) < RUN_SECONDS);
+    bench_sink = sum;
+
+    printf("%-5s %5d terms  %-12s %10.1f allocs/expr %8.2f ns/op\n", shape,
+           terms, names[kind], (double)allocations / EXPRESSIONS,
+           elapsed * 1e9 / ops);
+  }
+  for (int ix = 0; ix < EXPRESSIONS; ix++) {
+    free(codes[ix]);
+  }
+}
+
+void bench_stack() {
+  measure("wide", 16, false);
+  measure("wide", 256, false);
+  measure("deep", 16, true);
+  measure("deep", 256, true);
+}
@@ -0,0 +1,45 @@
+#include "batch.h"
+#include "bench.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+#define LINES 200000
+
+// Random infix lines of 4 to 19 terms, as a stream batch_run can read
+static FILE *generate_input() {
+  static const char operators[] = "+-*/%";
+  FILE *in = tmpfile();
+  srand(4);
+  for (int line = 0; line < LINES; line++) {
+    int terms = 4 + rand() % 16;
+    for (int ix = 0; ix < terms; ix++) {
+      fprintf(in, "%d", rand() % 1000 + 1);
+      if (ix + 1 < terms)
+        fprintf(in, " %c ", operators[rand() % 5]);
+    }
+    fputc('\n', in);
+  }
+  return in;
+}
+
+void bench_threads() {
+  FILE *in = generate_input();
+  FILE *out = fopen("/dev/null", "w");
+  printf("%ld online CPUs, %d lines\n", sysconf(_SC_NPROCESSORS_ONLN), LINES);
+
+  double single = 0;
+  for (int threads = 1; threads <= 64; threads *= 2) {
+    BatchOptions options = {parser_parse_infix, threads, 0};
+    BatchStats stats;
+    rewind(in);
+    batch_run(in, out, &options, &stats);
+    double rate = stats.expressions / stats.seconds;
+    if (threads == 1)
+      single = rate;
+    printf("%2d threads %12.0f expressions/sec %6.2fx\n", threads, rate,
+           rate / single);
+  }
+  fclose(out);
+  fclose(in);
+}
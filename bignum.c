@@ -0,0 +1,537 @@
+#include "bignum.h"
+#include <limits.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+// Decimal digits per conversion chunk and the chunk base, 10^9 < 2^32
+#define DECIMAL_CHUNK 9
+#define DECIMAL_BASE 1000000000U
+
+size_t bignum_karatsuba_threshold = KARATSUBA_THRESHOLD;
+
+struct bignum {
+  bool negative;
+  size_t len;      // Limbs in use, the top one is non-zero; 0 for zero
+  uint32_t *limbs; // Least significant first
+};
+
+static BigNum *bignum_alloc(size_t len) {
+  BigNum *num = malloc(sizeof(BigNum));
+  num->negative = false;
+  num->len = len;
+  num->limbs = calloc(len ? len : 1, sizeof(uint32_t));
+  return num;
+}
+
+// Drops leading zero limbs, zero is never negative
+static BigNum *trim(BigNum *num) {
+  while (num->len > 0 && num->limbs[num->len - 1] == 0) {
+    --(num->len);
+  }
+  if (num->len == 0)
+    num->negative = false;
+  return num;
+}
+
+static BigNum *copy(const BigNum *num) {
+  BigNum *result = bignum_alloc(num->len);
+  memcpy(result->limbs, num->limbs, num->len * sizeof(uint32_t));
+  result->negative = num->negative;
+  return result;
+}
+
+void bignum_free(BigNum *num) {
+  if (!num)
+    return;
+  free(num->limbs);
+  free(num);
+}
+
+BigNum *bignum_from_long(long int value) {
+  BigNum *num = bignum_alloc(2);
+  // Negate as unsigned so LONG_MIN works
+  unsigned long int magnitude =
+      value < 0 ? 0UL - (unsigned long int)value : (unsigned long int)value;
+  num->limbs[0] = (uint32_t)magnitude;
+  num->limbs[1] = (uint32_t)(magnitude >> 32);
+  num->negative = value < 0;
+  return trim(num);
+}
+
+bool bignum_to_long(const BigNum *num, long int *value) {
+  if (num->len > 2)
+    return false;
+  unsigned long int magnitude = 0;
+  for (size_t ix = num->len; ix > 0; ix--) {
+    magnitude = (magnitude << 32) | num->limbs[ix - 1];
+  }
+  if (magnitude > (unsigned long int)LONG_MAX + num->negative)
+    return false;
+  *value = num->negative ? (long int)(0UL - magnitude) : (long int)magnitude;
+  return true;
+}
+
+int bignum_sign(const BigNum *num) {
+  return num->len == 0 ? 0 : num->negative ? -1 : 1;
+}
+
+bool bignum_odd(const BigNum *num) {
+  return num->len > 0 && (num->limbs[0] & 1);
+}
+
+static size_t bit_length(const BigNum *num) {
+  if (num->len == 0)
+    return 0;
+  return num->len * 32 - __builtin_clz(num->limbs[num->len - 1]);
+}
+
+// Magnitude helpers work on raw limb arrays
+
+static int compare_limbs(const uint32_t *a, size_t na, const uint32_t *b,
+                         size_t nb) {
+  if (na != nb)
+    return na < nb ? -1 : 1;
+  for (size_t ix = na; ix > 0; ix--) {
+    if (a[ix - 1] != b[ix - 1])
+      return a[ix - 1] < b[ix - 1] ? -1 : 1;
+  }
+  return 0;
+}
+
+// dst[0..dn) += src[0..sn), sn <= dn, the sum must fit in dn limbs
+static void add_into(uint32_t *dst, size_t dn, const uint32_t *src,
+                     size_t sn) {
+  uint64_t carry = 0;
+  size_t ix = 0;
+  for (; ix < sn; ix++) {
+    carry += (uint64_t)dst[ix] + src[ix];
+    dst[ix] = (uint32_t)carry;
+    carry >>= 32;
+  }
+  for (; carry && ix < dn; ix++) {
+    carry += dst[ix];
+    dst[ix] = (uint32_t)carry;
+    carry >>= 32;
+  }
+}
+
+// dst[0..dn) -= src[0..sn), sn <= dn, dst must not be smaller than src
+static void sub_from(uint32_t *dst, size_t dn, const uint32_t *src,
+                     size_t sn) {
+  int64_t borrow = 0;
+  size_t ix = 0;
+  for (; ix < sn; ix++) {
+    int64_t diff = (int64_t)dst[ix] - src[ix] - borrow;
+    borrow = diff < 0;
+    dst[ix] = (uint32_t)diff;
+  }
+  for (; borrow && ix < dn; ix++) {
+    borrow = dst[ix] == 0;
+    --dst[ix];
+  }
+}
+
+// out[0..na+nb) = a * b, out must be zeroed
+static void mul_schoolbook(const uint32_t *a, size_t na, const uint32_t *b,
+                           size_t nb, uint32_t *out) {
+  for (size_t ix = 0; ix < na; ix++) {
+    uint64_t carry = 0;
+    for (size_t jx = 0; jx < nb; jx++) {
+      carry += (uint64_t)a[ix] * b[jx] + out[ix + jx];
+      out[ix + jx] = (uint32_t)carry;
+      carry >>= 32;
+    }
+    out[ix + nb] = (uint32_t)carry;
+  }
+}
+
+// out[0..na+nb) = a * b, splitting both operands in half so three half-size
+// products replace four: a*b = z2*B^2h + ((a0+a1)(b0+b1) - z0 - z2)*B^h + z0
+static void mul_limbs(const uint32_t *a, size_t na, const uint32_t *b,
+                      size_t nb, uint32_t *out) {
+  if (na < nb) {
+    const uint32_t *swap = a;
+    a = b;
+    b = swap;
+    size_t swap_len = na;
+    na = nb;
+    nb = swap_len;
+  }
+  if (nb < bignum_karatsuba_threshold) {
+    memset(out, 0, (na + nb) * sizeof(uint32_t));
+    mul_schoolbook(a, na, b, nb, out);
+    return;
+  }
+
+  size_t half = (na + 1) / 2;
+  if (nb <= half) {
+    // Lopsided: multiply b by each half of a
+    uint32_t *high = malloc((na - half + nb) * sizeof(uint32_t));
+    mul_limbs(a, half, b, nb, out);
+    memset(out + half + nb, 0, (na - half) * sizeof(uint32_t));
+    mul_limbs(a + half, na - half, b, nb, high);
+    add_into(out + half, na + nb - half, high, na - half + nb);
+    free(high);
+    return;
+  }
+
+  size_t a1_len = na - half, b1_len = nb - half;
+  // z0 and z2 go straight into the low and high parts of out
+  mul_limbs(a, half, b, half, out);
+  mul_limbs(a + half, a1_len, b + half, b1_len, out + 2 * half);
+
+  uint32_t *sums = calloc(2 * (half + 1), sizeof(uint32_t));
+  uint32_t *sum_a = sums, *sum_b = sums + half + 1;
+  memcpy(sum_a, a, half * sizeof(uint32_t));
+  add_into(sum_a, half + 1, a + half, a1_len);
+  memcpy(sum_b, b, half * sizeof(uint32_t));
+  add_into(sum_b, half + 1, b + half, b1_len);
+
+  size_t middle_len = 2 * half + 2;
+  uint32_t *middle = malloc(middle_len * sizeof(uint32_t));
+  mul_limbs(sum_a, half + 1, sum_b, half + 1, middle);
+  sub_from(middle, middle_len, out, 2 * half);
+  sub_from(middle, middle_len, out + 2 * half, a1_len + b1_len);
+  while (middle_len > 0 && middle[middle_len - 1] == 0) {
+    --middle_len;
+  }
+  add_into(out + half, na + nb - half, middle, middle_len);
+
+  free(middle);
+  free(sums);
+}
+
+// Divides u by a single limb in place, returns the remainder
+static uint32_t divide_small(uint32_t *u, size_t nu, uint32_t v) {
+  uint64_t remainder = 0;
+  for (size_t ix = nu; ix > 0; ix--) {
+    uint64_t current = (remainder << 32) | u[ix - 1];
+    u[ix - 1] = (uint32_t)(current / v);
+    remainder = current % v;
+  }
+  return (uint32_t)remainder;
+}
+
+// Knuth's algorithm D: q[0..nu-nv+1) = u / v and r[0..nv) = u % v for
+// nu >= nv >= 2, with the top limb of v non-zero
+static void divide_limbs(const uint32_t *u, size_t nu, const uint32_t *v,
+                         size_t nv, uint32_t *q, uint32_t *r) {
+  const uint64_t base = 1ULL << 32;
+  // Normalize so the top limb of v has its high bit set
+  int shift = __builtin_clz(v[nv - 1]);
+  uint32_t *vn = malloc(nv * sizeof(uint32_t));
+  uint32_t *un = malloc((nu + 1) * sizeof(uint32_t));
+  for (size_t ix = nv - 1; ix > 0; ix--) {
+    vn[ix] = (v[ix] << shift) | (uint32_t)((uint64_t)v[ix - 1] >> (32 - shift));
+  }
+  vn[0] = v[0] << shift;
+  un[nu] = (uint32_t)((uint64_t)u[nu - 1] >> (32 - shift));
+  for (size_t ix = nu - 1; ix > 0; ix--) {
+    un[ix] = (u[ix] << shift) | (uint32_t)((uint64_t)u[ix - 1] >> (32 - shift));
+  }
+  un[0] = u[0] << shift;
+
+  for (size_t jx = nu - nv + 1; jx-- > 0;) {
+    // Estimate the quotient limb from the top two limbs, then correct it
+    uint64_t top = ((uint64_t)un[jx + nv] << 32) | un[jx + nv - 1];
+    uint64_t qhat = top / vn[nv - 1];
+    uint64_t rhat = top % vn[nv - 1];
+    while (qhat >= base ||
+           qhat * vn[nv - 2] > ((rhat << 32) | un[jx + nv - 2])) {
+      --qhat;
+      rhat += vn[nv - 1];
+      if (rhat >= base)
+        break;
+    }
+
+    // un[jx..jx+nv] -= qhat * vn
+    int64_t borrow = 0, diff;
+    for (size_t ix = 0; ix < nv; ix++) {
+      uint64_t product = qhat * vn[ix];
+      diff = (int64_t)un[ix + jx] - borrow - (int64_t)(product & 0xFFFFFFFF);
+      un[ix + jx] = (uint32_t)diff;
+      borrow = (int64_t)(product >> 32) - (diff >> 32);
+    }
+    diff = (int64_t)un[jx + nv] - borrow;
+    un[jx + nv] = (uint32_t)diff;
+
+    q[jx] = (uint32_t)qhat;
+    // The estimate was one too large, add v back
+    if (diff < 0) {
+      --q[jx];
+      uint64_t carry = 0;
+      for (size_t ix = 0; ix < nv; ix++) {
+        carry += (uint64_t)un[ix + jx] + vn[ix];
+        un[ix + jx] = (uint32_t)carry;
+        carry >>= 32;
+      }
+      un[jx + nv] += (uint32_t)carry;
+    }
+  }
+
+  for (size_t ix = 0; ix < nv - 1; ix++) {
+    r[ix] = (un[ix] >> shift) | (uint32_t)((uint64_t)un[ix + 1] << (32 - shift));
+  }
+  r[nv - 1] = un[nv - 1] >> shift;
+  free(un);
+  free(vn);
+}
+
+// a + b where b's sign is given separately so subtraction can reuse it
+static BigNum *add_signed(const BigNum *a, const BigNum *b, bool b_negative) {
+  if (a->negative == b_negative) {
+    const BigNum *longer = a->len >= b->len ? a : b;
+    const BigNum *shorter = longer == a ? b : a;
+    BigNum *result = bignum_alloc(longer->len + 1);
+    memcpy(result->limbs, longer->limbs, longer->len * sizeof(uint32_t));
+    add_into(result->limbs, result->len, shorter->limbs, shorter->len);
+    result->negative = a->negative;
+    return trim(result);
+  }
+
+  // Opposite signs: subtract the smaller magnitude from the larger
+  int order = compare_limbs(a->limbs, a->len, b->limbs, b->len);
+  const BigNum *larger = order >= 0 ? a : b;
+  const BigNum *smaller = order >= 0 ? b : a;
+  BigNum *result = copy(larger);
+  sub_from(result->limbs, result->len, smaller->limbs, smaller->len);
+  result->negative = order >= 0 ? a->negative : b_negative;
+  return trim(result);
+}
+
+BigNum *bignum_add(const BigNum *a, const BigNum *b) {
+  return add_signed(a, b, b->negative);
+}
+
+BigNum *bignum_sub(const BigNum *a, const BigNum *b) {
+  return add_signed(a, b, !b->negative);
+}
+
+BigNum *bignum_abs(const BigNum *a) {
+  BigNum *result = copy(a);
+  result->negative = false;
+  return result;
+}
+
+BigNum *bignum_mul(const BigNum *a, const BigNum *b) {
+  if (a->len + b->len > BIGNUM_MAX_LIMBS)
+    return NULL;
+  if (a->len == 0 || b->len == 0)
+    return bignum_alloc(0);
+  BigNum *result = bignum_alloc(a->len + b->len);
+  mul_limbs(a->limbs, a->len, b->limbs, b->len, result->limbs);
+  result->negative = a->negative != b->negative;
+  return trim(result);
+}
+
+bool bignum_divmod(const BigNum *a, const BigNum *b, BigNum **quotient,
+                   BigNum **remainder) {
+  if (b->len == 0)
+    return false;
+
+  BigNum *q, *r;
+  if (compare_limbs(a->limbs, a->len, b->limbs, b->len) < 0) {
+    q = bignum_alloc(0);
+    r = copy(a);
+  } else if (b->len == 1) {
+    q = copy(a);
+    r = bignum_alloc(1);
+    r->limbs[0] = divide_small(q->limbs, q->len, b->limbs[0]);
+  } else {
+    q = bignum_alloc(a->len - b->len + 1);
+    r = bignum_alloc(b->len);
+    divide_limbs(a->limbs, a->len, b->limbs, b->len, q->limbs, r->limbs);
+  }
+  // Truncating division: the remainder follows the dividend
+  q->negative = a->negative != b->negative;
+  r->negative = a->negative;
+  trim(q);
+  trim(r);
+
+  if (quotient)
+    *quotient = q;
+  else
+    bignum_free(q);
+  if (remainder)
+    *remainder = r;
+  else
+    bignum_free(r);
+  return true;
+}
+
+BigNum *bignum_pow(const BigNum *base, unsigned long int exponent) {
+  if (exponent == 0)
+    return bignum_from_long(1);
+  // Powers of 0 and 1 stay put, anything else has at least exponent bits
+  size_t bits = bit_length(base);
+  if (bits > 1 && (bits - 1) > (size_t)BIGNUM_MAX_LIMBS * 32 / exponent)
+    return NULL;
+
+  BigNum *result = bignum_from_long(1);
+  BigNum *square = copy(base);
+  for (;;) {
+    if (exponent & 1) {
+      BigNum *product = bignum_mul(result, square);
+      bignum_free(result);
+      result = product;
+      if (!result)
+        break;
+    }
+    exponent >>= 1;
+    if (!exponent)
+      break;
+    BigNum *next = bignum_mul(square, square);
+    bignum_free(square);
+    square = next;
+    if (!square) {
+      bignum_free(result);
+      result = NULL;
+      break;
+    }
+  }
+  bignum_free(square);
+  return result;
+}
+
+// (a * b) % modulus for non-negative a and b below modulus
+static BigNum *mul_mod(const BigNum *a, const BigNum *b,
+                       const BigNum *modulus) {
+  BigNum *product = bignum_mul(a, b);
+  BigNum *remainder;
+  bignum_divmod(product, modulus, NULL, &remainder);
+  bignum_free(product);
+  return remainder;
+}
+
+BigNum *bignum_powmod(const BigNum *base, const BigNum *exponent,
+                      const BigNum *modulus) {
+  BigNum *positive_modulus = bignum_abs(modulus);
+  BigNum *positive_base = bignum_abs(base);
+  BigNum *factor;
+  bignum_divmod(positive_base, positive_modulus, NULL, &factor);
+  bignum_free(positive_base);
+
+  BigNum *one = bignum_from_long(1);
+  BigNum *result;
+  bignum_divmod(one, positive_modulus, NULL, &result);
+  bignum_free(one);
+
+  // Left to right over the exponent bits
+  for (size_t bit = bit_length(exponent); bit-- > 0;) {
+    BigNum *squared = mul_mod(result, result, positive_modulus);
+    bignum_free(result);
+    result = squared;
+    if (exponent->limbs[bit / 32] & (1U << (bit % 32))) {
+      BigNum *product = mul_mod(result, factor, positive_modulus);
+      bignum_free(result);
+      result = product;
+    }
+  }
+  bignum_free(factor);
+  bignum_free(positive_modulus);
+
+  // A negative base to an odd power gives a negative dividend
+  result->negative = base->negative && bignum_odd(exponent) && result->len;
+  return result;
+}
+
+BigNum *bignum_from_decimal(const char *text, size_t len) {
+  bool negative = len > 0 && text[0] == '-';
+  size_t start = negative;
+  // Enough limbs for len digits: log2(10) < 3.33 bits per digit
+  BigNum *num = bignum_alloc((len * 10 / 3) / 32 + 2);
+  size_t used = 0;
+
+  // Leading chunk so the rest are exactly DECIMAL_CHUNK digits
+  size_t chunk = (len - start) % DECIMAL_CHUNK;
+  if (chunk == 0)
+    chunk = DECIMAL_CHUNK;
+  for (size_t ix = start; ix < len; ix += chunk, chunk = DECIMAL_CHUNK) {
+    uint32_t value = 0, scale = 1;
+    for (size_t dx = 0; dx < chunk; dx++) {
+      value = value * 10 + (text[ix + dx] - '0');
+      scale *= 10;
+    }
+    // num = num * scale + value
+    uint64_t carry = value;
+    for (size_t lx = 0; lx < used; lx++) {
+      carry += (uint64_t)num->limbs[lx] * scale;
+      num->limbs[lx] = (uint32_t)carry;
+      carry >>= 32;
+    }
+    if (carry)
+      num->limbs[used++] = (uint32_t)carry;
+  }
+  num->len = used;
+  num->negative = negative;
+  return trim(num);
+}
+
+// Numbers up to this many limbs are converted one chunk at a time, larger
+// ones are split in half by a power of 10^9 first
+#define DECIMAL_SPLIT_LIMBS 64
+// Enough levels of 10^(9 * 2^k) for BIGNUM_MAX_LIMBS
+#define DECIMAL_LEVELS 32
+
+// Writes a non-negative number as exactly width digits, zero padded on the
+// left. powers[k] is 10^(9 * 2^k), filled in as the levels are needed.
+static void write_decimal(BigNum *num, size_t width, BigNum **powers,
+                          char *out) {
+  if (num->len <= DECIMAL_SPLIT_LIMBS) {
+    char *cp = out + width;
+    while (num->len > 0 && cp > out) {
+      uint32_t chunk = divide_small(num->limbs, num->len, DECIMAL_BASE);
+      trim(num);
+      for (int dx = 0; dx < DECIMAL_CHUNK && cp > out; dx++) {
+        *--cp = '0' + chunk % 10;
+        chunk /= 10;
+      }
+    }
+    memset(out, '0', cp - out);
+    return;
+  }
+
+  // Largest power at most about half the size of num
+  int level = 0;
+  for (;;) {
+    if (!powers[level + 1])
+      powers[level + 1] = bignum_mul(powers[level], powers[level]);
+    if (2 * powers[level + 1]->len > num->len + 1 ||
+        ((size_t)DECIMAL_CHUNK << (level + 1)) >= width)
+      break;
+    ++level;
+  }
+  size_t low_width = (size_t)DECIMAL_CHUNK << level;
+  BigNum *high, *low;
+  bignum_divmod(num, powers[level], &high, &low);
+  write_decimal(high, width - low_width, powers, out);
+  write_decimal(low, low_width, powers, out + width - low_width);
+  bignum_free(high);
+  bignum_free(low);
+}
+
+char *bignum_to_decimal(const BigNum *num) {
+  // 10^9 needs just under 30 bits, so this many digits always suffice
+  size_t width = (num->len * 32 / 29 + 1) * DECIMAL_CHUNK;
+  char *text = malloc(width + 2);
+  BigNum *powers[DECIMAL_LEVELS + 1] = {NULL};
+  BigNum *magnitude = bignum_abs(num);
+  powers[0] = bignum_from_long(DECIMAL_BASE);
+  write_decimal(magnitude, width, powers, text + 1);
+  bignum_free(magnitude);
+  for (int ix = 0; ix <= DECIMAL_LEVELS; ix++) {
+    bignum_free(powers[ix]);
+  }
+
+  // Drop the padding, keeping one digit for zero
+  size_t skip = 1;
+  while (skip < width && text[skip] == '0') {
+    ++skip;
+  }
+  if (num->negative)
+    text[--skip] = '-';
+  memmove(text, text + skip, width + 1 - skip);
+  text[width + 1 - skip] = '\0';
+  return text;
+}
@@ -0,0 +1,115 @@
+#ifndef BIGNUM_H
+#define BIGNUM_H
+
+#include <stdbool.h>
+#include <stddef.h>
+
+/*
+  Arbitrary-precision signed integers, stored as sign and magnitude in
+  base 2^32 limbs. Multiplication is schoolbook for small operands and
+  Karatsuba above KARATSUBA_THRESHOLD limbs, division is Knuth's
+  algorithm D. Division truncates toward zero and the remainder takes the
+  sign of the dividend, like '/' and '%' on long int.
+
+  Every operation returns a new number that the caller frees.
+*/
+
+// Operands shorter than this many limbs multiply with the schoolbook method
+#define KARATSUBA_THRESHOLD 32
+// Largest result allowed, about 40 million decimal digits
+#define BIGNUM_MAX_LIMBS (1 << 22)
+
+struct bignum;
+typedef struct bignum BigNum;
+
+// KARATSUBA_THRESHOLD unless changed, bench/bignum.c varies it to find the
+// crossover. Below 4 the half-size sums are no shorter than the operands.
+extern size_t bignum_karatsuba_threshold;
+
+/**
+ * @brief Creates a number from a long int.
+ */
+BigNum *bignum_from_long(long int value);
+
+/**
+ * @brief Creates a number from its decimal text.
+ *
+ * @param text An optional '-' followed by digits, not NUL terminated.
+ * @param len The length of text.
+ */
+BigNum *bignum_from_decimal(const char *text, size_t len);
+
+/**
+ * @brief Releases a number.
+ */
+void bignum_free(BigNum *num);
+
+/**
+ * @brief Formats a number as decimal text.
+ *
+ * @return char* The NUL terminated text, freed by the caller.
+ */
+char *bignum_to_decimal(const BigNum *num);
+
+/**
+ * @brief Converts a number to a long int if it fits.
+ *
+ * @return bool false if the number is out of range.
+ */
+bool bignum_to_long(const BigNum *num, long int *value);
+
+/**
+ * @brief Gets the sign of a number.
+ *
+ * @return int -1, 0 or 1.
+ */
+int bignum_sign(const BigNum *num);
+
+/**
+ * @brief Tells whether a number is odd.
+ */
+bool bignum_odd(const BigNum *num);
+
+BigNum *bignum_add(const BigNum *a, const BigNum *b);
+
+BigNum *bignum_sub(const BigNum *a, const BigNum *b);
+
+BigNum *bignum_abs(const BigNum *a);
+
+/**
+ * @brief Multiplies two numbers.
+ *
+ * @return BigNum* The product, or NULL if it exceeds BIGNUM_MAX_LIMBS.
+ */
+BigNum *bignum_mul(const BigNum *a, const BigNum *b);
+
+/**
+ * @brief Divides a by b.
+ *
+ * @param quotient Receives a / b, may be NULL if not needed.
+ * @param remainder Receives a % b, may be NULL if not needed.
+ * @return bool false if b is zero.
+ */
+bool bignum_divmod(const BigNum *a, const BigNum *b, BigNum **quotient,
+                   BigNum **remainder);
+
+/**
+ * @brief Raises base to a non-negative power by squaring.
+ *
+ * @return BigNum* The power, or NULL if it exceeds BIGNUM_MAX_LIMBS.
+ */
+BigNum *bignum_pow(const BigNum *base, unsigned long int exponent);
+
+/**
+ * @brief Computes base^exponent % modulus without forming base^exponent.
+ *
+ * The result matches bignum_pow followed by bignum_divmod, so it takes the
+ * sign of base^exponent.
+ *
+ * @param exponent Must not be negative.
+ * @param modulus Must not be zero.
+ */
+BigNum *bignum_powmod(const BigNum *base, const BigNum *exponent,
+                      const BigNum *modulus);
+
+#endif
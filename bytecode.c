@@ -0,0 +1,342 @@
+#include "bytecode.h"
+#include "optimizer.h"
+#include "profile.h"
+#include "real.h"
+#include "fastfloat.h"
+#include "threadpool.h"
+#include "util.h"
+#include "verify.h"
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+// Expressions evaluated before their results are written out in order
+#define BYTECODE_WINDOW 65536
+
+struct bytecode {
+  void *base;
+  size_t size;
+  const BytecodeHeader *header;
+  const BytecodeEntry *entries;
+  const Instruction *code;
+  int *max_depths; // Per entry, from verifying it on open
+};
+
+// One window of entries being evaluated, results[ix] belongs to first + ix
+typedef struct bytecode_window {
+  const Bytecode *bytecode;
+  uint64_t first;
+  long int values[BYTECODE_WINDOW];
+  int errors[BYTECODE_WINDOW];
+} BytecodeWindow;
+
+// FNV-1a over 64-bit words, folding the high half down after each step so
+// every bit of the input reaches the low bits of the hash. Every section of
+// the file is a whole number of words.
+static uint64_t checksum_update(uint64_t hash, const void *data, size_t len) {
+  const unsigned char *bytes = data;
+  for (size_t ix = 0; ix + sizeof(uint64_t) <= len; ix += sizeof(uint64_t)) {
+    uint64_t word;
+    memcpy(&word, bytes + ix, sizeof(word));
+    hash = (hash ^ word) * 1099511628211ULL;
+    hash ^= hash >> 32;
+  }
+  return hash;
+}
+
+// The flags decide how the code is run, so a flipped flag is corruption too
+static uint64_t checksum(uint32_t flags, const BytecodeEntry *entries,
+                         uint64_t entry_count, const Instruction *code,
+                         uint64_t code_len) {
+  uint64_t hash = 14695981039346656037ULL;
+  uint64_t flag_word = flags;
+  hash = checksum_update(hash, &flag_word, sizeof(flag_word));
+  hash = checksum_update(hash, entries, entry_count * sizeof(BytecodeEntry));
+  return checksum_update(hash, code, code_len * sizeof(Instruction));
+}
+
+static bool write_file(const char *path, uint32_t flags,
+                       const BytecodeEntry *entries, uint64_t entry_count,
+                       const Instruction *code, uint64_t code_len) {
+  BytecodeHeader header;
+  memset(&header, 0, sizeof(header));
+  memcpy(header.magic, BYTECODE_MAGIC, sizeof(header.magic));
+  header.version = BYTECODE_VERSION;
+  header.flags = flags;
+  header.instruction_size = sizeof(Instruction);
+  header.expression_count = entry_count;
+  header.instruction_count = code_len;
+  header.checksum = checksum(flags, entries, entry_count, code, code_len);
+
+  FILE *out = fopen(path, "wb");
+  if (!out)
+    return false;
+  bool written =
+      fwrite(&header, sizeof(header), 1, out) == 1 &&
+      fwrite(entries, sizeof(BytecodeEntry), entry_count, out) == entry_count &&
+      fwrite(code, sizeof(Instruction), code_len, out) == code_len;
+  int saved = errno;
+  if (fclose(out) != 0 && written) {
+    written = false;
+    saved = errno;
+  }
+  errno = saved;
+  return written;
+}
+
+bool bytecode_compile(FILE *in, const char *path, ParseFunc parse_func,
+                      BatchStats *stats) {
+  BytecodeEntry *entries = NULL;
+  size_t entry_count = 0, entry_cap = 0;
+  Instruction *code = NULL;
+  size_t code_len = 0, code_cap = 0;
+  char *line = NULL;
+  size_t line_cap = 0;
+  ssize_t len;
+  bool valid = true;
+  double start = util_seconds();
+
+  memset(stats, 0, sizeof(*stats));
+  while (valid && (len = getline(&line, &line_cap, in)) != -1) {
+    stats->bytes += len;
+    while (len > 0 && (line[len - 1] == '\n' || line[len - 1] == '\r')) {
+      --len;
+    }
+    valid = util_reserve((void **)&entries, &entry_cap, entry_count + 1,
+                    sizeof(BytecodeEntry));
+    if (!valid)
+      break;
+    BytecodeEntry *entry = &entries[entry_count++];
+    memset(entry, 0, sizeof(*entry));
+    entry->start = code_len;
+
+    Parser *parser = parser_new(line, len);
+    if (parse_func(parser)) {
+      int count;
+      const Instruction *compiled = parser_instructions(parser, &count);
+      valid = util_reserve((void **)&code, &code_cap, code_len + count,
+                      sizeof(Instruction));
+      if (valid) {
+        Instruction *slice = code + code_len;
+        memcpy(slice, compiled, count * sizeof(Instruction));
+        // The optimizer folds in long int arithmetic
+        if (!parser_float_flag)
+          count = optimizer_run(slice, count, NULL);
+        // Rebuild each instruction over zeroed padding so identical
+        // catalogs give identical files
+        for (int ix = 0; ix < count; ix++) {
+          Instruction instruction = slice[ix];
+          memset(&slice[ix], 0, sizeof(Instruction));
+          slice[ix].opcode = instruction.opcode;
+          slice[ix].value = instruction.value;
+        }
+        entry->len = count;
+        code_len += count;
+      }
+    } else {
+      entry->error = parser_parse_error(parser);
+      ++(stats->errors);
+    }
+    parser_free(parser);
+  }
+  free(line);
+  if (!valid)
+    errno = ENOMEM;
+
+  stats->expressions = entry_count;
+  if (valid)
+    valid = write_file(path, parser_float_flag ? BYTECODE_FLOAT : 0, entries,
+                       entry_count, code, code_len);
+  stats->seconds = util_seconds() - start;
+  free(entries);
+  free(code);
+  return valid;
+}
+
+// Checks that the header and every entry describe this file exactly, and
+// locates the sections
+static int validate(Bytecode *bytecode) {
+  const BytecodeHeader *header = bytecode->header;
+  if (bytecode->size < sizeof(BytecodeHeader) ||
+      memcmp(header->magic, BYTECODE_MAGIC, sizeof(header->magic)))
+    return BYTECODE_BAD_MAGIC;
+  if (header->version != BYTECODE_VERSION ||
+      header->instruction_size != sizeof(Instruction))
+    return BYTECODE_BAD_VERSION;
+
+  // Bound the counts first so the size computation cannot overflow
+  size_t body = bytecode->size - sizeof(BytecodeHeader);
+  if (header->expression_count > body / sizeof(BytecodeEntry) ||
+      header->instruction_count > body / sizeof(Instruction) ||
+      header->expression_count * sizeof(BytecodeEntry) +
+              header->instruction_count * sizeof(Instruction) !=
+          body)
+    return BYTECODE_CORRUPT;
+  bytecode->entries = (const BytecodeEntry *)(header + 1);
+  bytecode->code =
+      (const Instruction *)(bytecode->entries + header->expression_count);
+  if (checksum(header->flags, bytecode->entries, header->expression_count,
+               bytecode->code, header->instruction_count) != header->checksum)
+    return BYTECODE_CORRUPT;
+
+  // Entries that compiled must verify too, so they can run unchecked
+  bytecode->max_depths = malloc((header->expression_count + 1) * sizeof(int));
+  if (!bytecode->max_depths) {
+    errno = ENOMEM;
+    return BYTECODE_IO_ERROR;
+  }
+  for (uint64_t ix = 0; ix < header->expression_count; ix++) {
+    const BytecodeEntry *entry = &bytecode->entries[ix];
+    if (entry->start > header->instruction_count ||
+        entry->len > header->instruction_count - entry->start ||
+        entry->len > INT_MAX)
+      return BYTECODE_CORRUPT;
+    if (!entry->error &&
+        verify_program(bytecode->code + entry->start, entry->len,
+                       &bytecode->max_depths[ix]) != VALID)
+      return BYTECODE_CORRUPT;
+  }
+  return BYTECODE_OK;
+}
+
+Bytecode *bytecode_open(const char *path, int *error) {
+  int fd = open(path, O_RDONLY);
+  if (fd == -1) {
+    *error = BYTECODE_IO_ERROR;
+    return NULL;
+  }
+  struct stat st;
+  if (fstat(fd, &st) == -1) {
+    *error = BYTECODE_IO_ERROR;
+    close(fd);
+    return NULL;
+  }
+  if ((size_t)st.st_size < sizeof(BytecodeHeader)) {
+    *error = BYTECODE_BAD_MAGIC;
+    close(fd);
+    return NULL;
+  }
+
+  void *base = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+  // The mapping keeps the file alive without the descriptor
+  close(fd);
+  if (base == MAP_FAILED) {
+    *error = BYTECODE_IO_ERROR;
+    return NULL;
+  }
+
+  Bytecode *bytecode = malloc(sizeof(Bytecode));
+  if (!bytecode) {
+    munmap(base, st.st_size);
+    errno = ENOMEM;
+    *error = BYTECODE_IO_ERROR;
+    return NULL;
+  }
+  bytecode->base = base;
+  bytecode->size = st.st_size;
+  bytecode->header = base;
+  bytecode->max_depths = NULL;
+  *error = validate(bytecode);
+  if (*error) {
+    bytecode_close(bytecode);
+    return NULL;
+  }
+  return bytecode;
+}
+
+void bytecode_close(Bytecode *bytecode) {
+  if (!bytecode)
+    return;
+  munmap(bytecode->base, bytecode->size);
+  free(bytecode->max_depths);
+  free(bytecode);
+}
+
+const char *bytecode_error_string(int error) {
+  switch (error) {
+  case BYTECODE_IO_ERROR:
+    return strerror(errno);
+  case BYTECODE_BAD_MAGIC:
+    return "Not a bytecode file";
+  case BYTECODE_BAD_VERSION:
+    return "Bytecode from an incompatible version";
+  case BYTECODE_CORRUPT:
+    return "Bytecode file is corrupt";
+  }
+  return "Unknown Error";
+}
+
+static void evaluate_task(void *context, size_t index) {
+  BytecodeWindow *window = context;
+  const Bytecode *bytecode = window->bytecode;
+  const BytecodeEntry *entry = &bytecode->entries[window->first + index];
+  int err = entry->error;
+  long int value = 0;
+
+  if (!err) {
+    const Instruction *code = bytecode->code + entry->start;
+    uint64_t start = profile_flag ? profile_clock() : 0;
+    if (bytecode->header->flags & BYTECODE_FLOAT)
+      value = real_to_bits(real_execute(code, entry->len, NULL, &err));
+    else
+      value = parser_execute_verified(
+          code, entry->len, bytecode->max_depths[window->first + index],
+          parser_checked_flag, NULL, &err);
+    if (profile_flag)
+      profile_evaluated(code, entry->len, start, err);
+  }
+  window->values[index] = value;
+  window->errors[index] = err;
+}
+
+void bytecode_run(const Bytecode *bytecode, FILE *out, BatchOptions *options,
+                  BatchStats *stats) {
+  BytecodeWindow *window = malloc(sizeof(BytecodeWindow));
+  ThreadPool *pool =
+      options->threads > 1 ? threadpool_new(options->threads) : NULL;
+  uint64_t count = bytecode->header->expression_count;
+  bool real = bytecode->header->flags & BYTECODE_FLOAT;
+  double start = util_seconds();
+
+  // Nothing is lexed, so stats->bytes stays 0
+  memset(stats, 0, sizeof(*stats));
+  window->bytecode = bytecode;
+  for (window->first = 0; window->first < count;
+       window->first += BYTECODE_WINDOW) {
+    size_t size = count - window->first < BYTECODE_WINDOW
+                      ? count - window->first
+                      : BYTECODE_WINDOW;
+    if (pool) {
+      threadpool_run(pool, evaluate_task, window, size);
+    } else {
+      for (size_t ix = 0; ix < size; ix++) {
+        evaluate_task(window, ix);
+      }
+    }
+
+    for (size_t ix = 0; ix < size; ix++) {
+      if (window->errors[ix]) {
+        fprintf(out, "ERROR: %s\n", parser_error_string(window->errors[ix]));
+        ++(stats->errors);
+      } else if (real) {
+        char text[FASTFLOAT_FORMAT_LEN];
+        fastfloat_format(real_from_bits(window->values[ix]), text);
+        fprintf(out, "%s\n", text);
+      } else {
+        fprintf(out, "%ld\n", window->values[ix]);
+      }
+    }
+  }
+  fflush(out);
+  stats->expressions = count;
+  stats->seconds = util_seconds() - start;
+
+  if (pool)
+    threadpool_free(pool);
+  free(window);
+}
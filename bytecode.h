@@ -0,0 +1,106 @@
+#ifndef BYTECODE_H
+#define BYTECODE_H
+
+#include <stdint.h>
+#include <stdio.h>
+#include "batch.h"
+#include "parser.h"
+
+/*
+  Precompiled expression catalogs. A bytecode file holds the optimized
+  instructions of every line of a text catalog, so it can be evaluated
+  without lexing or parsing:
+
+    BytecodeHeader                        48 bytes
+    BytecodeEntry[expression_count]       16 bytes each, in line order
+    Instruction[instruction_count]        sizeof(Instruction) each
+
+  All fields are in the writer's byte order and every section is 8-byte
+  aligned, so a mapping of the file is used in place. The checksum covers
+  the header flags and everything after the header; the version changes
+  whenever the layout, the checksum or the opcode numbering does.
+*/
+
+#define BYTECODE_MAGIC "EXPRCODE"
+#define BYTECODE_VERSION 3
+
+enum bytecode_flags
+{
+  BYTECODE_FLOAT = 1 // Numbers are doubles, compiled in parser_float_mode
+};
+
+enum bytecode_errors
+{
+  BYTECODE_OK,
+  BYTECODE_IO_ERROR,
+  BYTECODE_BAD_MAGIC,
+  BYTECODE_BAD_VERSION,
+  BYTECODE_CORRUPT
+};
+
+typedef struct bytecode_header
+{
+  char magic[8];
+  uint32_t version;
+  uint32_t flags;
+  uint32_t instruction_size; // sizeof(Instruction) of the writer
+  uint32_t reserved;
+  uint64_t expression_count;
+  uint64_t instruction_count;
+  uint64_t checksum;
+} BytecodeHeader;
+
+typedef struct bytecode_entry
+{
+  uint64_t start; // Index of the first instruction
+  uint32_t len;
+  int32_t error; // parser_errors code if the line did not compile
+} BytecodeEntry;
+
+struct bytecode;
+typedef struct bytecode Bytecode;
+
+/**
+ * @brief Compiles newline-delimited expressions into a bytecode file.
+ *
+ * Lines that fail to parse are kept as entries carrying their error, so
+ * evaluating the file prints the same lines as batch_run on the text.
+ *
+ * @param in The stream the expressions are read from.
+ * @param path The file to write.
+ * @param parse_func The parser to use (infix or postfix).
+ * @param stats Receives the expression and error counts.
+ * @return bool false if the file could not be written, with errno set.
+ */
+bool bytecode_compile(FILE *in, const char *path, ParseFunc parse_func,
+                      BatchStats *stats);
+
+/**
+ * @brief Maps a bytecode file and validates it.
+ *
+ * @param error Receives a bytecode_errors code on failure, with errno set
+ *              for BYTECODE_IO_ERROR (ENOMEM when memory runs out).
+ * @return Bytecode* The mapped file, or NULL on failure.
+ */
+Bytecode *bytecode_open(const char *path, int *error);
+
+/**
+ * @brief Unmaps a bytecode file.
+ */
+void bytecode_close(Bytecode *bytecode);
+
+/**
+ * @brief Describes one of the bytecode_errors codes.
+ */
+const char *bytecode_error_string(int error);
+
+/**
+ * @brief Evaluates every expression of a bytecode file in order.
+ *
+ * Output matches batch_run on the catalog the file was compiled from.
+ * Only options->threads is used; there is no text to cache on.
+ */
+void bytecode_run(const Bytecode *bytecode, FILE *out, BatchOptions *options,
+                  BatchStats *stats);
+
+#endif
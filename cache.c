@@ -0,0 +1,193 @@
+#include "cache.h"
+#include <ctype.h>
+#include <pthread.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define MIN_SLOTS 64
+
+typedef struct cache_slot {
+  uint64_t hash; // 0 marks an empty slot
+  long int value;
+  int error;
+  unsigned short key_len;
+  unsigned char referenced;
+  char key[CACHE_KEY_LEN];
+} CacheSlot;
+
+struct cache {
+  CacheSlot *slots;
+  size_t mask; // capacity - 1, the capacity is a power of two
+  size_t count;
+  size_t max_count;
+  size_t hand;
+  pthread_mutex_t lock;
+  CacheStats stats;
+};
+
+static bool is_word(char c) { return isalnum((unsigned char)c) || c == '_'; }
+
+int cache_normalize(const char *src, size_t src_len, char *key) {
+  int len = 0;
+  const char *end = src + src_len;
+  for (const char *cp = src; cp < end; cp++) {
+    if (isspace((unsigned char)*cp)) {
+      while (cp + 1 < end && isspace((unsigned char)cp[1]))
+        ++cp;
+      char next = cp + 1 < end ? cp[1] : '\0';
+      char prev = len > 0 ? key[len - 1] : '\0';
+      // Keep the space only where removing it would change the tokens,
+      // including float literals such as "1.5" and "2e-3"
+      bool sign = prev == '-' || prev == '+';
+      if (!((is_word(prev) && is_word(next)) ||
+            (sign && isdigit((unsigned char)next)) || prev == '.' ||
+            next == '.' ||
+            ((prev == 'e' || prev == 'E') && (next == '-' || next == '+'))))
+        continue;
+    }
+    if (len == CACHE_KEY_LEN)
+      return -1;
+    key[len++] = isspace((unsigned char)*cp) ? ' ' : *cp;
+  }
+  key[len] = '\0';
+  return len;
+}
+
+// FNV-1a, never 0 so that 0 can mark empty slots
+static uint64_t hash_key(const char *key, int key_len) {
+  uint64_t hash = 14695981039346656037ULL;
+  for (int ix = 0; ix < key_len; ix++) {
+    hash ^= (unsigned char)key[ix];
+    hash *= 1099511628211ULL;
+  }
+  return hash ? hash : 1;
+}
+
+Cache *cache_new(size_t max_bytes) {
+  size_t capacity = MIN_SLOTS;
+  while (capacity * 2 * sizeof(CacheSlot) <= max_bytes) {
+    capacity *= 2;
+  }
+
+  Cache *cache = malloc(sizeof(Cache));
+  cache->slots = calloc(capacity, sizeof(CacheSlot));
+  cache->mask = capacity - 1;
+  cache->count = 0;
+  cache->max_count = capacity / 4 * 3;
+  cache->hand = 0;
+  pthread_mutex_init(&cache->lock, NULL);
+  memset(&cache->stats, 0, sizeof(CacheStats));
+  return cache;
+}
+
+void cache_free(Cache *cache) {
+  if (!cache)
+    return;
+  pthread_mutex_destroy(&cache->lock);
+  free(cache->slots);
+  free(cache);
+}
+
+// Finds the slot holding key, or the empty slot where it belongs
+static CacheSlot *find_slot(Cache *cache, uint64_t hash, const char *key,
+                            int key_len) {
+  size_t ix = hash & cache->mask;
+  for (;;) {
+    CacheSlot *slot = &cache->slots[ix];
+    if (!slot->hash || (slot->hash == hash && slot->key_len == key_len &&
+                        !memcmp(slot->key, key, key_len)))
+      return slot;
+    ix = (ix + 1) & cache->mask;
+  }
+}
+
+// Empties a slot, shifting later entries of the probe run back into it
+static void remove_slot(Cache *cache, size_t hole) {
+  size_t ix = hole;
+  for (;;) {
+    ix = (ix + 1) & cache->mask;
+    CacheSlot *slot = &cache->slots[ix];
+    if (!slot->hash)
+      break;
+    // Entries whose home lies cyclically in (hole, ix] must stay put
+    size_t home = slot->hash & cache->mask;
+    bool stays = hole <= ix ? (hole < home && home <= ix)
+                            : (hole < home || home <= ix);
+    if (stays)
+      continue;
+    cache->slots[hole] = *slot;
+    hole = ix;
+  }
+  cache->slots[hole].hash = 0;
+  --(cache->count);
+}
+
+// Advances the CLOCK hand until it finds an entry not hit since last pass
+static void evict(Cache *cache) {
+  for (;;) {
+    CacheSlot *slot = &cache->slots[cache->hand];
+    size_t victim = cache->hand;
+    cache->hand = (cache->hand + 1) & cache->mask;
+    if (!slot->hash)
+      continue;
+    if (slot->referenced) {
+      slot->referenced = 0;
+      continue;
+    }
+    remove_slot(cache, victim);
+    ++(cache->stats.evictions);
+    return;
+  }
+}
+
+bool cache_lookup(Cache *cache, const char *key, int key_len, long int *value,
+                  int *error) {
+  uint64_t hash = hash_key(key, key_len);
+  bool hit = false;
+
+  pthread_mutex_lock(&cache->lock);
+  CacheSlot *slot = find_slot(cache, hash, key, key_len);
+  if (slot->hash) {
+    slot->referenced = 1;
+    *value = slot->value;
+    *error = slot->error;
+    hit = true;
+    ++(cache->stats.hits);
+  } else {
+    ++(cache->stats.misses);
+  }
+  pthread_mutex_unlock(&cache->lock);
+  return hit;
+}
+
+void cache_insert(Cache *cache, const char *key, int key_len, long int value,
+                  int error) {
+  if (key_len < 0 || key_len > CACHE_KEY_LEN)
+    return;
+  uint64_t hash = hash_key(key, key_len);
+
+  pthread_mutex_lock(&cache->lock);
+  CacheSlot *slot = find_slot(cache, hash, key, key_len);
+  if (!slot->hash) {
+    if (cache->count >= cache->max_count) {
+      evict(cache);
+      // Eviction may have shifted entries, probe again
+      slot = find_slot(cache, hash, key, key_len);
+    }
+    slot->hash = hash;
+    slot->key_len = key_len;
+    slot->referenced = 0;
+    memcpy(slot->key, key, key_len);
+    ++(cache->count);
+  }
+  slot->value = value;
+  slot->error = error;
+  pthread_mutex_unlock(&cache->lock);
+}
+
+void cache_get_stats(Cache *cache, CacheStats *stats) {
+  pthread_mutex_lock(&cache->lock);
+  *stats = cache->stats;
+  pthread_mutex_unlock(&cache->lock);
+}
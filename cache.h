@@ -0,0 +1,71 @@
+#ifndef CACHE_H
+#define CACHE_H
+
+#include <stdbool.h>
+#include <stddef.h>
+
+/*
+  Fixed-memory result cache keyed by whitespace-normalized expression text.
+  Entries live in one open-addressing (linear probing) table sized from the
+  memory cap; once it is 3/4 full a CLOCK hand evicts entries that have not
+  been hit since it last passed them. All functions are thread-safe.
+*/
+
+// Longest normalized expression that can be cached
+#define CACHE_KEY_LEN 112
+
+struct cache;
+typedef struct cache Cache;
+
+typedef struct cache_stats
+{
+  long int hits;
+  long int misses;
+  long int evictions;
+} CacheStats;
+
+/**
+ * @brief Creates a cache.
+ *
+ * @param max_bytes The most memory the table may use.
+ * @return Cache* The new cache.
+ */
+Cache *cache_new(size_t max_bytes);
+
+/**
+ * @brief Releases the resources used by the given cache.
+ */
+void cache_free(Cache *cache);
+
+/**
+ * @brief Normalizes an expression into a cache key.
+ *
+ * Whitespace is dropped except where it separates two tokens that would
+ * otherwise lex differently ("1 2", "a b", "- 2"), where one space is kept.
+ *
+ * @param src The expression, len bytes that need not be NUL-terminated.
+ * @param key Receives the key, at least CACHE_KEY_LEN + 1 bytes.
+ * @return int The key length, or -1 if it is longer than CACHE_KEY_LEN.
+ */
+int cache_normalize(const char *src, size_t len, char *key);
+
+/**
+ * @brief Looks up the result stored for a key.
+ *
+ * @return bool true on a hit, with value and error filled in.
+ */
+bool cache_lookup(Cache *cache, const char *key, int key_len, long int *value,
+                  int *error);
+
+/**
+ * @brief Stores the result for a key, evicting an entry if the cache is full.
+ */
+void cache_insert(Cache *cache, const char *key, int key_len, long int value,
+                  int error);
+
+/**
+ * @brief Gets the hit, miss and eviction counters.
+ */
+void cache_get_stats(Cache *cache, CacheStats *stats);
+
+#endif
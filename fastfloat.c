@@ -0,0 +1,393 @@
+#include "fastfloat.h"
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+
+// IEEE double layout
+#define MANTISSA_BITS 52
+#define EXPONENT_BIAS 1023
+#define INFINITE_POWER 0x7FF
+// Decimal exponents covered by fastfloat_power_of_five
+#define SMALLEST_POWER_OF_TEN (-342)
+#define LARGEST_POWER_OF_TEN 308
+// Significant digits that always fit in a uint64_t
+#define MAX_DIGITS 19
+// Exponents past this are infinity or zero anyway, stop accumulating
+#define MAX_EXPONENT_DIGITS 100000
+// Longest number strtod gets from the stack before needing the heap
+#define SLOW_BUFFER_LEN 128
+
+// Grisu2 scales the boundaries so their binary exponent lands in [-60, -32],
+// this is the lower end
+#define GRISU_ALPHA (-60)
+// Decimal exponent of fastfloat_cached_powers[0] and the step between entries
+#define CACHED_POWERS_MIN_K (-300)
+#define CACHED_POWERS_STEP 8
+
+// Every power of ten that is exact in a double
+static const double exact_powers_of_ten[] = {
+    1e0,  1e1,  1e2,  1e3,  1e4,  1e5,  1e6,  1e7,  1e8,  1e9,  1e10, 1e11,
+    1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22};
+
+static inline bool is_digit(char c) { return (unsigned char)(c - '0') < 10; }
+
+static double from_bits(uint64_t bits) {
+  double value;
+  memcpy(&value, &bits, sizeof(value));
+  return value;
+}
+
+// Eisel-Lemire: the bits of the double nearest to w * 10^q, or -1 when the
+// truncated 128-bit product cannot decide the rounding
+static int64_t eisel_lemire(int64_t q, uint64_t w) {
+  if (w == 0 || q < SMALLEST_POWER_OF_TEN)
+    return 0;
+  if (q > LARGEST_POWER_OF_TEN)
+    return (int64_t)INFINITE_POWER << MANTISSA_BITS;
+
+  int lz = __builtin_clzll(w);
+  w <<= lz;
+  const uint64_t *power = fastfloat_power_of_five[q - SMALLEST_POWER_OF_TEN];
+  unsigned __int128 product = (unsigned __int128)w * power[0];
+  uint64_t high = product >> 64, low = (uint64_t)product;
+  // Only the top 55 bits matter, the low table word is needed only when a
+  // carry out of the rest could still change them
+  const uint64_t precision_mask = UINT64_MAX >> (MANTISSA_BITS + 3);
+  if ((high & precision_mask) == precision_mask) {
+    uint64_t second = ((unsigned __int128)w * power[1]) >> 64;
+    low += second;
+    if (second > low)
+      ++high;
+  }
+  if (low == UINT64_MAX && (q < -27 || q > 55))
+    return -1;
+
+  int upperbit = high >> 63;
+  int shift = upperbit + 64 - MANTISSA_BITS - 3;
+  uint64_t mantissa = high >> shift;
+  // floor(log2(10^q)) + 63, then rebased on the exponent bias
+  int64_t power2 = (((152170 + 65536) * q) >> 16) + 63 + upperbit - lz +
+                   EXPONENT_BIAS;
+
+  if (power2 <= 0) {
+    // Subnormal, shift down to the fixed minimum exponent then round
+    if (-power2 + 1 >= 64)
+      return 0;
+    mantissa >>= -power2 + 1;
+    mantissa += mantissa & 1;
+    mantissa >>= 1;
+    power2 = mantissa < (1ULL << MANTISSA_BITS) ? 0 : 1;
+    return (power2 << MANTISSA_BITS) | mantissa;
+  }
+
+  // Exactly halfway between two doubles, round to even instead of up
+  if (low <= 1 && q >= -4 && q <= 23 && (mantissa & 3) == 1 &&
+      (mantissa << shift) == high)
+    mantissa &= ~1ULL;
+  mantissa += mantissa & 1;
+  mantissa >>= 1;
+  if (mantissa >= (2ULL << MANTISSA_BITS)) {
+    mantissa = 1ULL << MANTISSA_BITS;
+    ++power2;
+  }
+  mantissa &= ~(1ULL << MANTISSA_BITS);
+  if (power2 >= INFINITE_POWER)
+    return (int64_t)INFINITE_POWER << MANTISSA_BITS;
+  return (power2 << MANTISSA_BITS) | mantissa;
+}
+
+// strtod needs a NUL terminated copy of the number
+static double slow_parse(const char *start, const char *end) {
+  char buffer[SLOW_BUFFER_LEN];
+  size_t len = end - start;
+  char *text = len < SLOW_BUFFER_LEN ? buffer : malloc(len + 1);
+  memcpy(text, start, len);
+  text[len] = '\0';
+  double value = strtod(text, NULL);
+  if (text != buffer)
+    free(text);
+  return value;
+}
+
+const char *fastfloat_parse(const char *cp, const char *end, double *value) {
+  bool negative = *cp == '-';
+  cp += negative;
+  const char *start = cp;
+
+  // Up to MAX_DIGITS significant digits, the rest only move the exponent
+  uint64_t w = 0;
+  int digits = 0;
+  int64_t exponent = 0;
+  bool truncated = false;
+  for (; cp < end && is_digit(*cp); cp++) {
+    if (digits < MAX_DIGITS) {
+      w = w * 10 + (*cp - '0');
+      digits += w != 0;
+    } else {
+      ++exponent;
+      truncated |= *cp != '0';
+    }
+  }
+  if (cp < end && *cp == '.') {
+    for (++cp; cp < end && is_digit(*cp); cp++) {
+      if (digits < MAX_DIGITS) {
+        w = w * 10 + (*cp - '0');
+        digits += w != 0;
+        --exponent;
+      } else {
+        truncated |= *cp != '0';
+      }
+    }
+  }
+  if (cp < end && (*cp == 'e' || *cp == 'E')) {
+    const char *marker = cp + 1;
+    bool exponent_negative = false;
+    if (marker < end && (*marker == '+' || *marker == '-')) {
+      exponent_negative = *marker == '-';
+      ++marker;
+    }
+    if (marker < end && is_digit(*marker)) {
+      int64_t explicit_exponent = 0;
+      for (; marker < end && is_digit(*marker); marker++) {
+        if (explicit_exponent < MAX_EXPONENT_DIGITS)
+          explicit_exponent = explicit_exponent * 10 + (*marker - '0');
+      }
+      exponent += exponent_negative ? -explicit_exponent : explicit_exponent;
+      cp = marker;
+    }
+  }
+
+  double result;
+  if (w == 0) {
+    result = 0;
+  } else if (!truncated && exponent >= -22 && exponent <= 22 &&
+             w <= (1ULL << (MANTISSA_BITS + 1))) {
+    // Clinger: both operands are exact, so one IEEE operation rounds right
+    result = exponent < 0 ? (double)w / exact_powers_of_ten[-exponent]
+                          : (double)w * exact_powers_of_ten[exponent];
+  } else {
+    int64_t bits = eisel_lemire(exponent, w);
+    // Dropped digits put the value between w and w + 1
+    if (truncated && bits != eisel_lemire(exponent, w + 1))
+      bits = -1;
+    result = bits >= 0 ? from_bits(bits) : slow_parse(start, cp);
+  }
+  *value = negative ? -result : result;
+  return cp;
+}
+
+// A floating point value f * 2^e with a 64-bit significand
+typedef struct diy_fp {
+  uint64_t f;
+  int e;
+} DiyFp;
+
+// x * y rounded to the upper 64 bits of the product
+static DiyFp diy_mul(DiyFp x, DiyFp y) {
+  unsigned __int128 product = (unsigned __int128)x.f * y.f;
+  uint64_t high = product >> 64, low = (uint64_t)product;
+  DiyFp result = {high + (low >> 63), x.e + y.e + 64};
+  return result;
+}
+
+static DiyFp diy_normalize(DiyFp x) {
+  int shift = __builtin_clzll(x.f);
+  x.f <<= shift;
+  x.e -= shift;
+  return x;
+}
+
+// The cached power that brings a binary exponent e into the Grisu2 range
+static const CachedPower *cached_power(int e) {
+  int f = GRISU_ALPHA - e - 1;
+  // ceil(f * log10(2))
+  int k = (f * 78913) / (1 << 18) + (f > 0);
+  int index = (-CACHED_POWERS_MIN_K + k + (CACHED_POWERS_STEP - 1)) /
+              CACHED_POWERS_STEP;
+  return &fastfloat_cached_powers[index];
+}
+
+// Walks the last digit down while that moves it closer to w and keeps it
+// inside the boundaries
+static void grisu_round(char *digits, int len, uint64_t dist, uint64_t delta,
+                        uint64_t rest, uint64_t ten_k) {
+  while (rest < dist && delta - rest >= ten_k &&
+         (rest + ten_k < dist || dist - rest > rest + ten_k - dist)) {
+    --digits[len - 1];
+    rest += ten_k;
+  }
+}
+
+// Generates the shortest digits of a number in (low, high) near w, all
+// scaled by the same cached power; *exponent is adjusted to match
+static int grisu_digits(char *digits, int *exponent, DiyFp low, DiyFp w,
+                        DiyFp high) {
+  uint64_t delta = high.f - low.f;
+  uint64_t dist = high.f - w.f;
+  // high = p1 + p2 * 2^e with p1 the integral and p2 the fractional part
+  int shift = -high.e;
+  uint64_t one = 1ULL << shift;
+  uint32_t p1 = high.f >> shift;
+  uint64_t p2 = high.f & (one - 1);
+  int len = 0;
+
+  uint32_t pow10 = 1;
+  int n = 1;
+  while (n < 10 && p1 / pow10 >= 10) {
+    pow10 *= 10;
+    ++n;
+  }
+  while (n > 0) {
+    digits[len++] = '0' + p1 / pow10;
+    p1 %= pow10;
+    --n;
+    uint64_t rest = ((uint64_t)p1 << shift) + p2;
+    if (rest <= delta) {
+      *exponent += n;
+      grisu_round(digits, len, dist, delta, rest, (uint64_t)pow10 << shift);
+      return len;
+    }
+    pow10 /= 10;
+  }
+
+  int m = 0;
+  for (;;) {
+    p2 *= 10;
+    digits[len++] = '0' + (p2 >> shift);
+    p2 &= one - 1;
+    ++m;
+    delta *= 10;
+    dist *= 10;
+    if (p2 <= delta)
+      break;
+  }
+  *exponent -= m;
+  grisu_round(digits, len, dist, delta, p2, one);
+  return len;
+}
+
+// Grisu2 for a positive finite double, returns the digit count
+static int grisu2(double value, char *digits, int *exponent) {
+  uint64_t bits;
+  memcpy(&bits, &value, sizeof(bits));
+  uint64_t fraction = bits & ((1ULL << MANTISSA_BITS) - 1);
+  int biased = bits >> MANTISSA_BITS;
+  int min_exponent = 1 - EXPONENT_BIAS - MANTISSA_BITS;
+  DiyFp v = biased == 0
+                ? (DiyFp){fraction, min_exponent}
+                : (DiyFp){fraction | (1ULL << MANTISSA_BITS), biased + min_exponent - 1};
+
+  // Halfway to the neighbouring doubles, the one below is closer at a power
+  // of two
+  bool lower_closer = fraction == 0 && biased > 1;
+  DiyFp upper = diy_normalize((DiyFp){2 * v.f + 1, v.e - 1});
+  DiyFp lower = lower_closer ? (DiyFp){4 * v.f - 1, v.e - 2}
+                             : (DiyFp){2 * v.f - 1, v.e - 1};
+  lower.f <<= lower.e - upper.e;
+  lower.e = upper.e;
+
+  const CachedPower *cached = cached_power(upper.e);
+  DiyFp scale = {cached->f, cached->e};
+  DiyFp w = diy_mul(diy_normalize(v), scale);
+  DiyFp low = diy_mul(lower, scale);
+  DiyFp high = diy_mul(upper, scale);
+  // The products may be off by one ulp, stay strictly inside
+  ++low.f;
+  --high.f;
+  *exponent = -cached->k;
+  return grisu_digits(digits, exponent, low, w, high);
+}
+
+// Grisu2 misses the shortest digits in about 0.1% of cases. Tries the
+// neighbours with one digit less, nearest first, and keeps any that still
+// reads back as the same bits.
+static int shorten(char *digits, int len, int *exponent, uint64_t bits) {
+  while (len > 1) {
+    uint64_t w = 0;
+    for (int ix = 0; ix < len - 1; ix++) {
+      w = w * 10 + (digits[ix] - '0');
+    }
+    uint64_t candidate = digits[len - 1] >= '5' ? w + 1 : w;
+    if (eisel_lemire(*exponent + 1, candidate) != (int64_t)bits) {
+      candidate = candidate == w ? w + 1 : w;
+      if (eisel_lemire(*exponent + 1, candidate) != (int64_t)bits)
+        break;
+    }
+
+    // Rounding up can carry into a new leading digit, trailing zeros go
+    ++(*exponent);
+    while (candidate % 10 == 0) {
+      candidate /= 10;
+      ++(*exponent);
+    }
+    char reversed[20];
+    len = 0;
+    for (; candidate; candidate /= 10) {
+      reversed[len++] = '0' + candidate % 10;
+    }
+    for (int ix = 0; ix < len; ix++) {
+      digits[ix] = reversed[len - 1 - ix];
+    }
+  }
+  return len;
+}
+
+int fastfloat_format(double value, char *out) {
+  char *cp = out;
+  if (value != value) {
+    strcpy(out, "nan");
+    return 3;
+  }
+  if (__builtin_signbit(value)) {
+    *cp++ = '-';
+    value = -value;
+  }
+  if (value == 0 || value > 1.7976931348623157e308) {
+    strcpy(cp, value == 0 ? "0" : "inf");
+    return cp - out + strlen(cp);
+  }
+
+  char digits[20];
+  int exponent;
+  int len = grisu2(value, digits, &exponent);
+  uint64_t bits;
+  memcpy(&bits, &value, sizeof(bits));
+  len = shorten(digits, len, &exponent, bits);
+  // Position of the decimal point relative to the first digit
+  int point = len + exponent;
+
+  if (len <= point && point <= 21) {
+    memcpy(cp, digits, len);
+    memset(cp + len, '0', point - len);
+    cp += point;
+  } else if (0 < point && point <= 21) {
+    memcpy(cp, digits, point);
+    cp[point] = '.';
+    memcpy(cp + point + 1, digits + point, len - point);
+    cp += len + 1;
+  } else if (-6 < point && point <= 0) {
+    *cp++ = '0';
+    *cp++ = '.';
+    memset(cp, '0', -point);
+    memcpy(cp - point, digits, len);
+    cp += len - point;
+  } else {
+    *cp++ = digits[0];
+    if (len > 1) {
+      *cp++ = '.';
+      memcpy(cp, digits + 1, len - 1);
+      cp += len - 1;
+    }
+    int shown = point - 1;
+    *cp++ = 'e';
+    *cp++ = shown < 0 ? '-' : '+';
+    shown = shown < 0 ? -shown : shown;
+    if (shown >= 100)
+      *cp++ = '0' + shown / 100;
+    if (shown >= 10)
+      *cp++ = '0' + shown / 10 % 10;
+    *cp++ = '0' + shown % 10;
+  }
+  *cp = '\0';
+  return cp - out;
+}
@@ -0,0 +1,54 @@
+#ifndef FASTFLOAT_H
+#define FASTFLOAT_H
+
+#include <stdint.h>
+
+/*
+  Conversions between decimal text and double for parser_float_mode.
+
+  Parsing is exact: small inputs take Clinger's fast path, the rest the
+  Eisel-Lemire algorithm (one or two 64x128-bit multiplications against a
+  table of powers of five), and the rare inputs it cannot decide fall back
+  to strtod. Formatting is Grisu2, which prints the fewest digits that read
+  back as the same double in practically every case, and never a double
+  that reads back differently.
+*/
+
+// Longest text fastfloat_format writes, with its NUL terminator
+#define FASTFLOAT_FORMAT_LEN 32
+
+// 10^k ~= f * 2^e, one entry every 8 decimal exponents
+typedef struct cached_power {
+  uint64_t f;
+  int e;
+  int k;
+} CachedPower;
+
+extern const uint64_t fastfloat_power_of_five[][2];
+extern const CachedPower fastfloat_cached_powers[];
+
+/**
+ * @brief Converts a decimal number to the nearest double.
+ *
+ * Accepts '-'? DIGIT+ ('.' DIGIT*)? (('e'|'E') ('+'|'-')? DIGIT+)?; an
+ * exponent marker without digits after it is not consumed.
+ *
+ * @param cp The start of the number, which must be a digit or '-' digit.
+ * @param end The end of the text, which need not be NUL terminated.
+ * @param value Receives the double.
+ * @return const char* Just past the number.
+ */
+const char *fastfloat_parse(const char *cp, const char *end, double *value);
+
+/**
+ * @brief Formats a double with the shortest digits that read back to it.
+ *
+ * Uses plain notation for magnitudes from 1e-6 up to 1e21 and exponent
+ * notation ("1.5e+300") outside them, like JavaScript.
+ *
+ * @param out Receives at most FASTFLOAT_FORMAT_LEN chars.
+ * @return int The length written, excluding the NUL terminator.
+ */
+int fastfloat_format(double value, char *out);
+
+#endif
@@ -0,0 +1,486 @@
+#include "jit.h"
+#include "arith.h"
+#include "verify.h"
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#if defined(__x86_64__)
+#include <sys/mman.h>
+#include <unistd.h>
+
+// Upper bound on the machine code emitted for one instruction
+#define MAX_OP_BYTES 96
+// Largest spill frame placed on the C stack, deeper programs are not compiled
+#define MAX_FRAME_BYTES (1 << 20)
+
+typedef long int (*JitFunc)(const long int *values, int *error);
+
+struct jit_code {
+  void *memory;
+  size_t size;
+  bool uses_variables;
+  JitFunc func;
+};
+
+enum registers {
+  RAX, RCX, RDX, RBX, RSP, RBP, RSI, RDI,
+  R8, R9, R10, R11, R12, R13, R14, R15
+};
+
+// Stack slot n lives in slot_registers[n], deeper slots spill to the frame.
+// rax/rcx/rdx are scratch (idiv needs rax:rdx), rdi holds the values
+// pointer and rsi the error pointer.
+static const int slot_registers[] = {RBX, R12, R13, R14, R15,
+                                     RBP, R8,  R9,  R10, R11};
+#define SLOT_REGISTERS ((int)(sizeof(slot_registers) / sizeof(int)))
+#define CALLEE_SAVED 6
+
+// Condition codes for jcc
+#define CC_OVERFLOW 0x0
+#define CC_ZERO 0x4
+
+// A jump to the exit reporting error, patched once the exits are placed
+typedef struct fixup {
+  size_t at; // Offset of the rel32 to patch
+  int error;
+} Fixup;
+
+typedef struct assembler {
+  uint8_t *code;
+  size_t len;
+  int frame_size;
+  bool checked; // Emit overflow and zero divisor checks
+  Fixup *fixups;
+  int fixup_count;
+} Assembler;
+
+static void byte(Assembler *as, uint8_t b) { as->code[as->len++] = b; }
+
+static void imm32(Assembler *as, int32_t value) {
+  memcpy(as->code + as->len, &value, 4);
+  as->len += 4;
+}
+
+static void imm64(Assembler *as, int64_t value) {
+  memcpy(as->code + as->len, &value, 8);
+  as->len += 8;
+}
+
+// jcc rel32 to the exit that reports error. This is all checked code adds
+// to add, sub, mul and neg: one never-taken jump to a shared exit, with no
+// flag to reload. bench checked still measures 9-20% over unchecked code,
+// short of the 5% aimed for. The 6-byte jo cannot fuse with imul, and
+// straight-line code with no loads has nothing to hide it behind.
+static void jump_error(Assembler *as, uint8_t condition, int error) {
+  byte(as, 0x0F);
+  byte(as, 0x80 | condition);
+  as->fixups[as->fixup_count].at = as->len;
+  as->fixups[as->fixup_count++].error = error;
+  imm32(as, 0);
+}
+
+static void rex_w(Assembler *as, int reg, int rm) {
+  byte(as, 0x48 | ((reg >> 3) << 2) | (rm >> 3));
+}
+
+static void modrm_rr(Assembler *as, int reg, int rm) {
+  byte(as, 0xC0 | ((reg & 7) << 3) | (rm & 7));
+}
+
+// [base + disp32], rsp and r12 as base need a SIB byte
+static void modrm_mem(Assembler *as, int reg, int base, int32_t disp) {
+  byte(as, 0x80 | ((reg & 7) << 3) | (base & 7));
+  if ((base & 7) == RSP)
+    byte(as, 0x24);
+  imm32(as, disp);
+}
+
+// op dst, src for the "op r/m64, r64" encodings (mov, add, sub)
+static void alu_rr(Assembler *as, uint8_t opcode, int dst, int src) {
+  rex_w(as, src, dst);
+  byte(as, opcode);
+  modrm_rr(as, src, dst);
+}
+
+static void mov_rr(Assembler *as, int dst, int src) {
+  if (dst != src)
+    alu_rr(as, 0x89, dst, src);
+}
+
+static void mov_imm(Assembler *as, int dst, int64_t value) {
+  rex_w(as, 0, dst);
+  byte(as, 0xB8 + (dst & 7));
+  imm64(as, value);
+}
+
+static void load(Assembler *as, int dst, int base, int32_t disp) {
+  rex_w(as, dst, base);
+  byte(as, 0x8B);
+  modrm_mem(as, dst, base, disp);
+}
+
+static void store(Assembler *as, int base, int32_t disp, int src) {
+  rex_w(as, src, base);
+  byte(as, 0x89);
+  modrm_mem(as, src, base, disp);
+}
+
+static void push(Assembler *as, int reg) {
+  if (reg >= R8)
+    byte(as, 0x41);
+  byte(as, 0x50 + (reg & 7));
+}
+
+static void pop(Assembler *as, int reg) {
+  if (reg >= R8)
+    byte(as, 0x41);
+  byte(as, 0x58 + (reg & 7));
+}
+
+static void neg(Assembler *as, int reg) {
+  rex_w(as, 0, reg);
+  byte(as, 0xF7);
+  modrm_rr(as, 3, reg);
+}
+
+static void adjust_rsp(Assembler *as, int32_t amount) {
+  if (amount == 0)
+    return;
+  // add rsp, imm32 / sub rsp, imm32
+  byte(as, 0x48);
+  byte(as, 0x81);
+  byte(as, amount > 0 ? 0xC4 : 0xEC);
+  imm32(as, amount > 0 ? amount : -amount);
+}
+
+static bool spilled(int slot) { return slot >= SLOT_REGISTERS; }
+
+static int32_t spill_offset(int slot) {
+  return (slot - SLOT_REGISTERS) * (int32_t)sizeof(long int);
+}
+
+// Gets the register holding slot, loading spilled slots into scratch
+static int read_slot(Assembler *as, int slot, int scratch) {
+  if (!spilled(slot))
+    return slot_registers[slot];
+  load(as, scratch, RSP, spill_offset(slot));
+  return scratch;
+}
+
+// Stores reg into slot unless the slot already lives there
+static void write_slot(Assembler *as, int slot, int reg) {
+  if (spilled(slot))
+    store(as, RSP, spill_offset(slot), reg);
+  else
+    mov_rr(as, slot_registers[slot], reg);
+}
+
+// The code runs on after an error, so keep the first one like the
+// interpreters do; the caller discards the result
+static long int jit_pow(long int base, long int exponent, int *error) {
+  long int result = 0;
+  int err = arith_pow(base, exponent, &result);
+  if (err && !*error)
+    *error = err;
+  return result;
+}
+
+// Calls jit_pow(a, b, error) keeping the values pointer, error pointer and
+// any live caller-saved slots below depth intact; the result is left in rax
+static void call_pow(Assembler *as, int a, int b, int depth) {
+  int saved[SLOT_REGISTERS + 2];
+  int count = 0;
+  saved[count++] = RDI;
+  saved[count++] = RSI;
+  for (int slot = CALLEE_SAVED; slot < depth && slot < SLOT_REGISTERS; slot++) {
+    saved[count++] = slot_registers[slot];
+  }
+
+  for (int ix = 0; ix < count; ix++) {
+    push(as, saved[ix]);
+  }
+  // The frame is 16-byte aligned, keep it that way across the call
+  if (count % 2)
+    adjust_rsp(as, -8);
+  mov_rr(as, RDX, RSI);
+  mov_rr(as, RDI, a);
+  mov_rr(as, RSI, b);
+  mov_imm(as, RAX, (int64_t)(intptr_t)jit_pow);
+  byte(as, 0xFF); // call rax
+  byte(as, 0xD0);
+  if (count % 2)
+    adjust_rsp(as, 8);
+  for (int ix = count - 1; ix >= 0; ix--) {
+    pop(as, saved[ix]);
+  }
+}
+
+// Computes slot a_slot = a_slot op b, where b is already in a register.
+// safe_divisor says b is a constant that / and % need not check.
+static void emit_binary(Assembler *as, TokenType opcode, int a_slot, int b,
+                        bool safe_divisor) {
+  int a = read_slot(as, a_slot, RAX);
+
+  switch (opcode) {
+  case add:
+    alu_rr(as, 0x01, a, b);
+    if (as->checked)
+      jump_error(as, CC_OVERFLOW, ARITHMETIC_OVERFLOW);
+    break;
+  case sub:
+    alu_rr(as, 0x29, a, b);
+    if (as->checked)
+      jump_error(as, CC_OVERFLOW, ARITHMETIC_OVERFLOW);
+    break;
+  case mul:
+    // imul a, b
+    rex_w(as, a, b);
+    byte(as, 0x0F);
+    byte(as, 0xAF);
+    modrm_rr(as, a, b);
+    if (as->checked)
+      jump_error(as, CC_OVERFLOW, ARITHMETIC_OVERFLOW);
+    break;
+  case divide:
+  case mod: {
+    size_t not_minus_one = 0, done = 0;
+    bool check = as->checked && !safe_divisor;
+    if (check) {
+      alu_rr(as, 0x85, b, b); // test b, b
+      jump_error(as, CC_ZERO, DIVISION_BY_ZERO);
+      rex_w(as, 0, b); // cmp b, -1
+      byte(as, 0x83);
+      modrm_rr(as, 7, b);
+      byte(as, 0xFF);
+      byte(as, 0x75); // jne rel8
+      not_minus_one = as->len;
+      byte(as, 0);
+      // idiv traps on LONG_MIN / -1: x / -1 is -x and x % -1 is 0
+      if (opcode == divide) {
+        neg(as, a);
+        jump_error(as, CC_OVERFLOW, ARITHMETIC_OVERFLOW);
+      } else {
+        alu_rr(as, 0x31, a, a); // xor a, a
+      }
+      byte(as, 0xEB); // jmp rel8
+      done = as->len;
+      byte(as, 0);
+      as->code[not_minus_one] = as->len - (not_minus_one + 1);
+    }
+    mov_rr(as, RAX, a);
+    byte(as, 0x48); // cqo
+    byte(as, 0x99);
+    rex_w(as, 0, b); // idiv b
+    byte(as, 0xF7);
+    modrm_rr(as, 7, b);
+    mov_rr(as, a, opcode == divide ? RAX : RDX);
+    if (check)
+      as->code[done] = as->len - (done + 1);
+    break;
+  }
+  default: // power
+    call_pow(as, a, b, a_slot);
+    mov_rr(as, a, RAX);
+    break;
+  }
+  write_slot(as, a_slot, a);
+}
+
+static void emit_abs(Assembler *as, int depth) {
+  int slot = depth - 1;
+  int value = read_slot(as, slot, RCX);
+  mov_rr(as, RAX, value);
+  neg(as, RAX);
+  // Only LONG_MIN overflows when negated
+  if (as->checked)
+    jump_error(as, CC_OVERFLOW, ARITHMETIC_OVERFLOW);
+  rex_w(as, RAX, value); // cmovs rax, value
+  byte(as, 0x0F);
+  byte(as, 0x48);
+  modrm_rr(as, RAX, value);
+  write_slot(as, slot, RAX);
+}
+
+static void emit_push(Assembler *as, TokenType opcode, long int operand,
+                      int depth) {
+  int reg = spilled(depth) ? RAX : slot_registers[depth];
+  if (opcode == number)
+    mov_imm(as, reg, operand);
+  else
+    load(as, reg, RDI, (int32_t)(operand * sizeof(long int)));
+  write_slot(as, depth, reg);
+}
+
+static void emit_prologue(Assembler *as) {
+  for (int ix = 0; ix < CALLEE_SAVED; ix++) {
+    push(as, slot_registers[ix]);
+  }
+  adjust_rsp(as, -as->frame_size);
+}
+
+static void emit_epilogue(Assembler *as) {
+  mov_rr(as, RAX, slot_registers[0]);
+  adjust_rsp(as, as->frame_size);
+  for (int ix = CALLEE_SAVED - 1; ix >= 0; ix--) {
+    pop(as, slot_registers[ix]);
+  }
+  byte(as, 0xC3); // ret
+}
+
+// Places one exit per error after the epilogue and points the checks at it.
+// An exit records its error unless jit_pow already recorded one, then
+// returns 0 through the epilogue.
+static void emit_error_exits(Assembler *as, size_t epilogue) {
+  static const int errors[] = {ARITHMETIC_OVERFLOW, DIVISION_BY_ZERO};
+  for (int ix = 0; ix < (int)(sizeof(errors) / sizeof(int)); ix++) {
+    size_t exit = as->len;
+    bool used = false;
+    for (int fx = 0; fx < as->fixup_count; fx++) {
+      if (as->fixups[fx].error != errors[ix])
+        continue;
+      int32_t rel = exit - (as->fixups[fx].at + 4);
+      memcpy(as->code + as->fixups[fx].at, &rel, 4);
+      used = true;
+    }
+    if (!used)
+      continue;
+    byte(as, 0x83); // cmp dword [rsi], 0
+    byte(as, 0x3E);
+    byte(as, 0x00);
+    byte(as, 0x75); // jne over the store
+    byte(as, 0x06);
+    byte(as, 0xC7); // mov dword [rsi], error
+    byte(as, 0x06);
+    imm32(as, errors[ix]);
+    alu_rr(as, 0x31, slot_registers[0], slot_registers[0]);
+    byte(as, 0xE9); // jmp epilogue
+    imm32(as, epilogue - (as->len + 4));
+  }
+}
+
+// Temporaries live in the frame above the spilled slots
+static void emit_store_temp(Assembler *as, int depth, int32_t offset) {
+  store(as, RSP, offset, read_slot(as, depth - 1, RCX));
+}
+
+static void emit_load_temp(Assembler *as, int depth, int32_t offset) {
+  int reg = spilled(depth) ? RAX : slot_registers[depth];
+  load(as, reg, RSP, offset);
+  write_slot(as, depth, reg);
+}
+
+// Finds whether the program reads variables and how many temporaries it
+// keeps, false if it holds an opcode the JIT does not compile
+static bool scan_opcodes(const Instruction *code, int len,
+                         bool *uses_variables, int *temps) {
+  *uses_variables = false;
+  *temps = 0;
+  for (int ix = 0; ix < len; ix++) {
+    if (code[ix].opcode == big_number)
+      return false;
+    if (code[ix].opcode == variable)
+      *uses_variables = true;
+    if (code[ix].opcode == store_temp && code[ix].value >= *temps)
+      *temps = code[ix].value + 1;
+  }
+  return true;
+}
+
+JitCode *jit_compile(const Instruction *code, int len, bool checked) {
+  int max_depth, temps;
+  bool uses_variables;
+  if (verify_program(code, len, &max_depth) != VALID ||
+      !scan_opcodes(code, len, &uses_variables, &temps) ||
+      (long)max_depth * 8 > MAX_FRAME_BYTES)
+    return NULL;
+
+  long page = sysconf(_SC_PAGESIZE);
+  size_t size = ((size_t)len * MAX_OP_BYTES + 256 + page - 1) / page * page;
+  void *memory = mmap(NULL, size, PROT_READ | PROT_WRITE,
+                      MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+  if (memory == MAP_FAILED)
+    return NULL;
+
+  Assembler as = {memory, 0, 0, checked, NULL, 0};
+  // At most two checks per instruction
+  if (as.checked)
+    as.fixups = malloc(((size_t)len * 2 + 1) * sizeof(Fixup));
+  // After the six pushes rsp is 8 off 16-byte alignment
+  int spills = max_depth > SLOT_REGISTERS ? max_depth - SLOT_REGISTERS : 0;
+  int32_t temp_base = spills * 8;
+  as.frame_size = (spills + temps) * 8;
+  if (as.frame_size % 16 == 0)
+    as.frame_size += 8;
+
+  emit_prologue(&as);
+  int depth = 0;
+  for (int ix = 0; ix < len; ix++) {
+    TokenType opcode = code[ix].opcode;
+    if (opcode == number || opcode == variable) {
+      emit_push(&as, opcode, code[ix].value, depth);
+      ++depth;
+    } else if (opcode == absolute) {
+      emit_abs(&as, depth);
+    } else if (opcode == store_temp) {
+      emit_store_temp(&as, depth, temp_base + code[ix].value * 8);
+    } else if (opcode == load_temp) {
+      emit_load_temp(&as, depth, temp_base + code[ix].value * 8);
+      ++depth;
+    } else if (opcode >= add_imm) {
+      mov_imm(&as, RCX, code[ix].value);
+      emit_binary(&as, add + (opcode - add_imm), depth - 1, RCX,
+                  arith_safe_divisor(code[ix].value));
+    } else {
+      emit_binary(&as, opcode, depth - 2, read_slot(&as, depth - 1, RCX),
+                  false);
+      --depth;
+    }
+  }
+  size_t epilogue = as.len;
+  emit_epilogue(&as);
+  emit_error_exits(&as, epilogue);
+  free(as.fixups);
+
+  if (mprotect(memory, size, PROT_READ | PROT_EXEC)) {
+    munmap(memory, size);
+    return NULL;
+  }
+
+  JitCode *jit = malloc(sizeof(JitCode));
+  jit->memory = memory;
+  jit->size = size;
+  jit->uses_variables = uses_variables;
+  jit->func = (JitFunc)memory;
+  return jit;
+}
+
+void jit_free(JitCode *jit) {
+  if (!jit)
+    return;
+  munmap(jit->memory, jit->size);
+  free(jit);
+}
+
+long int jit_run(const JitCode *jit, const long int *values, int *error) {
+  if (jit->uses_variables && !values) {
+    *error = UNBOUND_VARIABLE;
+    return 0;
+  }
+  return jit->func(values, error);
+}
+
+#else
+
+JitCode *jit_compile(const Instruction *code, int len, bool checked) {
+  return NULL;
+}
+
+void jit_free(JitCode *jit) {}
+
+long int jit_run(const JitCode *jit, const long int *values, int *error) {
+  *error = INVALID_EXPRESSION;
+  return 0;
+}
+
+#endif
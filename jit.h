@@ -0,0 +1,44 @@
+#ifndef JIT_H
+#define JIT_H
+
+#include "parser.h"
+
+/*
+  Native x86-64 compiler for instruction streams. Each stack slot of the
+  expression is assigned a machine register (deep expressions spill the
+  rest to the native stack frame), and the code is placed in mmap'd
+  executable memory.
+
+  Only well-formed programs are compiled: jit_compile returns NULL when the
+  host is not x86-64, executable memory is unavailable, or the code contains
+  an opcode or stack shape the JIT does not handle, and callers fall back to
+  an interpreter.
+*/
+
+struct jit_code;
+typedef struct jit_code JitCode;
+
+/**
+ * @brief Compiles an instruction stream to native code.
+ *
+ * @param code The instructions to compile.
+ * @param len The number of instructions.
+ * @param checked Whether to emit checked arithmetic, see
+ *                parser_checked_mode.
+ * @return JitCode* The compiled code, or NULL if it cannot be compiled.
+ */
+JitCode *jit_compile(const Instruction *code, int len, bool checked);
+
+/**
+ * @brief Releases compiled code and its executable memory.
+ */
+void jit_free(JitCode *jit);
+
+/**
+ * @brief Runs compiled code.
+ *
+ * @param values The variable bindings by slot, may be NULL.
+ */
+long int jit_run(const JitCode *jit, const long int *values, int *error);
+
+#endif
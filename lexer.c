@@ -1,45 +1,89 @@
 #include <string.h>
 #include <stdlib.h>
 #include <stdio.h>
-#include <ctype.h>
+#include <limits.h>
 #include <stdbool.h>
+#include <stdint.h>
+#include "fastfloat.h"
 #include "lexer.h"
-
-#define MAX_CODE_LEN 4096
+#include "scan.h"
 
 int lexer_debug_flag = 0;
+int lexer_float_flag = 0;
+
+typedef struct token_entry
+{
+  TokenType type;
+  const char *text;
+  size_t len; // 0 for entries that are never matched against the input
+} TokenEntry;
 
 //Table to look up correct token type
 // More useful if we wanted to add more usable functions/operators
-Token token_table[] = {{add, "+", 1},
-                       {sub, "-", 1},
-                       {mul, "*", 1},
-                       {divide, "/", 1},
-                       {mod, "%", 1},
-                       {power, "^", 1},
-                       {absolute, "abs", 3},
-                       {number, "0", 0},
-                       {end, "", 0},
-                       {left_paren, "(", 1},
-                       {right_paren, ")", 1},
-                       {unknown, " ", 1}};
-
-int token_table_size = sizeof(token_table) / sizeof(Token);
+// Position is same as the TokenType enum
+const TokenEntry token_table[] = {{add, "+", 1},
+                                  {sub, "-", 1},
+                                  {mul, "*", 1},
+                                  {divide, "/", 1},
+                                  {mod, "%", 1},
+                                  {power, "^", 1},
+                                  {absolute, "abs", 3},
+                                  {number, "0", 0},
+                                  {variable, "", 0},
+                                  {add_imm, "", 0},
+                                  {sub_imm, "", 0},
+                                  {mul_imm, "", 0},
+                                  {divide_imm, "", 0},
+                                  {mod_imm, "", 0},
+                                  {power_imm, "", 0},
+                                  {store_temp, "", 0},
+                                  {load_temp, "", 0},
+                                  {big_number, "", 0},
+                                  {end, "", 0},
+                                  {left_paren, "(", 1},
+                                  {right_paren, ")", 1},
+                                  {unknown, "", 0}};
+
+// Single character operators, indexed by the character itself
+static const TokenEntry *const operator_table[256] = {
+    ['+'] = &token_table[add],        ['-'] = &token_table[sub],
+    ['*'] = &token_table[mul],        ['/'] = &token_table[divide],
+    ['%'] = &token_table[mod],        ['^'] = &token_table[power],
+    ['('] = &token_table[left_paren], [')'] = &token_table[right_paren]};
+
+// Perfect hash over the keywords, the compiler evaluates it to place them in
+// keyword_table. A new keyword must land on a free slot (-Woverride-init
+// reports a clash); if it does not, grow KEYWORD_SLOTS or tune the factors.
+// Names with the same length, first and last characters (asin, atan) always
+// clash, hash the second character too before adding them; see
+// bench/keywords.c.
+#define KEYWORD_SLOTS 16
+#define KEYWORD_HASH(len, first, last)                                        \
+  (((len) * 5 + (unsigned char)(first) * 3 + (unsigned char)(last)) &         \
+   (KEYWORD_SLOTS - 1))
+
+static const TokenEntry *const keyword_table[KEYWORD_SLOTS] = {
+    [KEYWORD_HASH(3, 'a', 's')] = &token_table[absolute]};
 
 struct lexer
 {
-  char source_code[4096];
-  char *cp;
-  Token *cur_token;
+  const char *source_code;
+  const char *cp;
+  const char *end;
+  Token cur_token;
 };
 
-Lexer *lexer_new(char *src)
+Lexer *lexer_new(const char *src, size_t len)
 {
   Lexer *new_lexer = malloc(sizeof(Lexer));
-  strcpy(new_lexer->source_code, src);
-  //Need to set to a pointer in order for advance token to not segfault
-  new_lexer->cur_token = &token_table[unknown];
-  new_lexer->cp = new_lexer->source_code;
+  new_lexer->source_code = src;
+  new_lexer->cp = src;
+  new_lexer->end = src + len;
+  new_lexer->cur_token.type = unknown;
+  new_lexer->cur_token.offset = 0;
+  new_lexer->cur_token.len = 0;
+  new_lexer->cur_token.value = 0;
+  new_lexer->cur_token.overflow = false;
 
   return new_lexer;
 }
@@ -51,108 +95,152 @@ void lexer_free(Lexer *lexer)
 
 Token *lexer_get_token(Lexer *lexer)
 {
-  return lexer->cur_token;
+  return &lexer->cur_token;
 }
 
-void read_number(Lexer *lexer, int *total_len, bool negative)
+const char *lexer_token_text(Lexer *lexer, const Token *token)
 {
-  int num_len = 0;
-  // read in the negative sign if present
-  if (negative)
+  return lexer->source_code + token->offset;
+}
+
+// Is there a character left to read and is it in one of the char_classes
+static bool lexer_at(Lexer *lexer, int classes)
+{
+  return lexer->cp < lexer->end && (scan_class[(unsigned char)*(lexer->cp)] & classes);
+}
+
+// Value of 8 ASCII digits, most significant first, in one 64-bit word.
+// Each step merges neighbouring groups: digit pairs, then 4-digit and
+// finally 8-digit values.
+static uint64_t parse_eight_digits(const char *digits)
+{
+  uint64_t chunk;
+  memcpy(&chunk, digits, sizeof(chunk));
+  chunk -= 0x3030303030303030ULL;
+  chunk = (chunk * 10 + (chunk >> 8)) & 0x00FF00FF00FF00FFULL;
+  chunk = (chunk * 100 + (chunk >> 16)) & 0x0000FFFF0000FFFFULL;
+  return (chunk * 10000 + (chunk >> 32)) & 0xFFFFFFFFULL;
+}
+
+// Converts a run of digits, returns false if it does not fit in 64 bits
+static bool parse_digits(const char *digits, size_t len, uint64_t *value)
+{
+  uint64_t result = 0;
+  size_t ix = 0;
+  bool overflow = false;
+
+#if __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+  for (; ix + 8 <= len; ix += 8)
   {
-    num_len++;
-    (lexer->cp)++;
+    overflow |= __builtin_mul_overflow(result, 100000000ULL, &result);
+    overflow |= __builtin_add_overflow(result, parse_eight_digits(digits + ix), &result);
   }
+#endif
+  for (; ix < len; ix++)
+  {
+    overflow |= __builtin_mul_overflow(result, 10ULL, &result);
+    overflow |= __builtin_add_overflow(result, (uint64_t)(digits[ix] - '0'), &result);
+  }
+  *value = result;
+  return !overflow;
+}
 
-  while (*(lexer->cp) && isdigit(*(lexer->cp)))
+// Reads a number and converts it in the same pass
+void read_number(Lexer *lexer, bool negative)
+{
+  Token *token = &lexer->cur_token;
+  if (lexer_float_flag)
   {
-    num_len++;
-    (lexer->cp)++;
+    lexer->cp = fastfloat_parse(lexer->cp, lexer->end, &token->real);
+    token->value = 0;
+    token->overflow = false;
+    return;
   }
-  strncpy(lexer->cur_token->buf, lexer->cp - num_len, num_len);
-  lexer->cur_token->buf[num_len] = '\0';
-  *total_len += num_len;
+  // read in the negative sign if present
+  if (negative)
+    (lexer->cp)++;
+
+  const char *digits = lexer->cp;
+  lexer->cp = scan_digits(lexer->cp, lexer->end);
+
+  uint64_t magnitude;
+  // -LONG_MIN is one more than LONG_MAX
+  uint64_t limit = (uint64_t)LONG_MAX + negative;
+  token->overflow = !parse_digits(digits, lexer->cp - digits, &magnitude) || magnitude > limit;
+  if (token->overflow)
+    token->value = negative ? LONG_MIN : LONG_MAX;
+  else
+    token->value = negative ? (long int)(0 - magnitude) : (long int)magnitude;
+}
+
+// Returns the keyword spelled by the name, NULL for a variable name
+static const TokenEntry *lookup_keyword(const char *name, size_t len)
+{
+  const TokenEntry *entry = keyword_table[KEYWORD_HASH(len, name[0], name[len - 1])];
+  if (entry && entry->len == len && !memcmp(entry->text, name, len))
+    return entry;
+  return NULL;
 }
 
 void lexer_advance_token(Lexer *lexer)
 {
   if (lexer_debug_flag)
     fprintf(stderr, "[LEXER] Advancing token... \n");
-  int total_len = 0;
-  bool is_negative = false;
-  Token *cur_token = lexer->cur_token;
-  while (*(lexer->cp) && isspace(*(lexer->cp)))
-  {
-    ++(lexer->cp);
-    ++total_len;
-  }
+  lexer->cp = scan_spaces(lexer->cp, lexer->end);
+
+  const char *start = lexer->cp;
+  TokenType prev_type = lexer->cur_token.type;
+  Token *token = &lexer->cur_token;
+  token->offset = start - lexer->source_code;
+
   // Number is one special case
-  if (isdigit(*(lexer->cp)))
+  if (lexer_at(lexer, CLASS_DIGIT))
   {
-    lexer->cur_token = &token_table[number];
-    read_number(lexer, &total_len, false);
+    token->type = number;
+    read_number(lexer, false);
+    token->len = lexer->cp - start;
     if (lexer_debug_flag)
-      printf("[LEXER] Found number: %s\n", lexer->cur_token->buf);
-    lexer->cur_token->total_len = total_len;
+      printf("[LEXER] Found number: %.*s\n", (int)token->len, start);
     return;
   }
-  char buf[MAX_TOKEN_LEN] = "";
 
-  // accumulate function name
-  if (isalpha(*(lexer->cp)))
+  // accumulate function or variable name
+  if (lexer_at(lexer, CLASS_ALPHA))
   {
-    int word_len = 0;
-    // read in the negative sign if present
-
-    while (*(lexer->cp) && isalpha(*(lexer->cp)))
-    {
-      ++word_len;
+    while (lexer_at(lexer, CLASS_NAME))
       ++(lexer->cp);
-    }
-    strncpy(buf, lexer->cp - word_len, word_len);
-    lexer->cur_token->buf[word_len] = '\0';
-    total_len += word_len;
+    token->len = lexer->cp - start;
+    const TokenEntry *keyword = lookup_keyword(start, token->len);
+    token->type = keyword ? keyword->type : variable;
   }
   // If not a function assume its an operator that takes one char
   // Not the best but works in our simple case, not easily expandable to multichar operators
-  else if (ispunct(*(lexer->cp)))
+  else if (lexer_at(lexer, CLASS_PUNCT))
   {
-    strncpy(buf, lexer->cp, 1);
-    buf[1] = '\0';
-
+    const TokenEntry *op = operator_table[(unsigned char)*(lexer->cp)];
     ++(lexer->cp);
-  }
-  bool found = false;
-  if (lexer_debug_flag)
-    printf("[LEXER] Searching for %s\n", buf);
-  for (int ix = 0; ix < token_table_size; ix++)
-  {
-    if (!strcmp(buf, token_table[ix].buf))
+    token->len = 1;
+    token->type = op ? op->type : unknown;
+    // need to check if prev token was a right paren, number or variable to handle the following cases:
+    //      (1 + 2)-2, 4-2 and x-2
+    // If only we only use the fact that the following char is a digit we error on cases where there was just no space
+    if (token->type == sub && lexer_at(lexer, CLASS_DIGIT) && prev_type != right_paren && prev_type != number &&
+        prev_type != variable)
     {
-      found = true;
-      TokenType prev_type = lexer->cur_token->type;
-      lexer->cur_token = &token_table[ix];
-      // need to check if prev token was a right paren or number to handle the following cases:
-      //      (1 + 2)-2 and 4-2
-      // If only we only use the fact that the following char is a digit we error on cases where there was just no space
-      if (token_table[ix].type == sub && isdigit(*lexer->cp) && prev_type != right_paren && prev_type != number)
-      {
-        lexer->cp--;
-        lexer->cur_token = &token_table[number];
-        read_number(lexer, &total_len, true);
-      }
-
-      break;
+      lexer->cp = start;
+      token->type = number;
+      read_number(lexer, true);
+      token->len = lexer->cp - start;
     }
   }
-
-  if (!found)
+  // Nothing left to read (or nothing the lexer understands) ends the input
+  else
   {
-    lexer->cur_token = &token_table[unknown];
+    token->len = 0;
+    token->type = end;
   }
 
-  lexer->cur_token->total_len = total_len;
   if (lexer_debug_flag)
-    fprintf(stderr, "[LEXER] Token Found: '%s', type %d, len %d\n", lexer->cur_token->buf,
-            lexer->cur_token->type, lexer->cur_token->total_len);
+    fprintf(stderr, "[LEXER] Token Found: '%.*s', type %d, len %zu\n", (int)token->len,
+            start, token->type, token->len);
 }
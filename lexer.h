@@ -1,7 +1,8 @@
 #ifndef LEXER_H
 #define LEXER_H
 
-#define MAX_TOKEN_LEN 64
+#include <stdbool.h>
+#include <stddef.h>
 
 typedef enum token_type
 {
@@ -13,6 +14,20 @@ typedef enum token_type
   power,
   absolute,
   number,
+  variable,
+  // Bytecode only: operators fused with their right operand
+  add_imm,
+  sub_imm,
+  mul_imm,
+  divide_imm,
+  mod_imm,
+  power_imm,
+  // Bytecode only: a shared subexpression kept in a temporary, see
+  // optimizer_run
+  store_temp,
+  load_temp,
+  // Bytecode only: a literal too large for a long int, see parser_precise_mode
+  big_number,
   end,
   left_paren,
   right_paren,
@@ -22,14 +37,20 @@ typedef enum token_type
 struct lexer;
 typedef struct lexer Lexer;
 
+// Tokens are not copied out of the source, they point back into it
 typedef struct token
 {
   TokenType type;
-  char buf[MAX_TOKEN_LEN];
-  int total_len;
+  size_t offset; // Start of the token text in the source
+  size_t len;    // Length of the token text
+  long int value; // Value of a number token, converted while lexing
+  bool overflow;  // The number token does not fit in a long int
+  double real;    // Value of a number token in float mode
 } Token;
 
 extern int lexer_debug_flag;
+// Numbers may have a fraction and an exponent, see parser_float_mode
+extern int lexer_float_flag;
 
 /**
  * @brief Advances the lexer to the next token.
@@ -39,10 +60,15 @@ void lexer_advance_token(Lexer *lexer);
 /**
  * @brief Creates a Lexer object.
  *
- * @param src The string that must be analyzed
+ * The lexer works directly on the caller's buffer, which must stay alive
+ * and unchanged until the lexer is freed. It does not need to be NUL
+ * terminated.
+ *
+ * @param src The text that must be analyzed
+ * @param len The length of src
  * @return Lexer* The new Lexer object.
  */
-Lexer *lexer_new(char *src);
+Lexer *lexer_new(const char *src, size_t len);
 
 /**
  * @brief Frees the resources of the given lexer.
@@ -55,4 +81,9 @@ void lexer_free(Lexer *lexer);
  */
 Token *lexer_get_token(Lexer *lexer);
 
+/**
+ * @brief Gets the text of a token, which is token->len chars long.
+ */
+const char *lexer_token_text(Lexer *lexer, const Token *token);
+
 #endif
\ No newline at end of file
@@ -0,0 +1,248 @@
+#include "loadgen.h"
+#include "util.h"
+#include <errno.h>
+#include <math.h>
+#include <poll.h>
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#define LOADGEN_READ_SIZE 65536
+
+// The catalog every connection sends, each line ends in '\n'
+typedef struct catalog {
+  char *text;
+  size_t *ends; // ends[ix] is the offset just past line ix
+  size_t count;
+} Catalog;
+
+typedef struct connection {
+  pthread_t thread;
+  const char *path;
+  const Catalog *catalog;
+  double *sent_at;   // When each line was fully written
+  double *latencies; // Microseconds, one per answered line that was sent
+  size_t samples;    // Latencies recorded
+  long int errors;
+  int error; // errno of a failed connection, 0 on success
+} Connection;
+
+static bool read_catalog(FILE *in, Catalog *catalog) {
+  size_t len = 0, cap = 0, ends_cap = 0;
+  char *line = NULL;
+  size_t line_cap = 0;
+  ssize_t got;
+
+  memset(catalog, 0, sizeof(*catalog));
+  while ((got = getline(&line, &line_cap, in)) != -1) {
+    if (got > 0 && line[got - 1] == '\n')
+      --got;
+    if (!util_reserve((void **)&catalog->text, &cap, len + got + 1, 1) ||
+        !util_reserve((void **)&catalog->ends, &ends_cap, catalog->count + 1,
+                      sizeof(size_t)))
+      break;
+    memcpy(catalog->text + len, line, got);
+    len += got;
+    catalog->text[len++] = '\n';
+    catalog->ends[catalog->count++] = len;
+  }
+  free(line);
+  if (got != -1) {
+    errno = ENOMEM;
+    return false;
+  }
+  return true;
+}
+
+static int connect_socket(const char *path) {
+  struct sockaddr_un addr;
+  memset(&addr, 0, sizeof(addr));
+  addr.sun_family = AF_UNIX;
+  if (strlen(path) >= sizeof(addr.sun_path)) {
+    errno = ENAMETOOLONG;
+    return -1;
+  }
+  strcpy(addr.sun_path, path);
+
+  int fd = socket(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+  if (fd == -1)
+    return -1;
+  // Connecting to a Unix socket completes or fails immediately
+  if (connect(fd, (struct sockaddr *)&addr, sizeof(addr)) == -1) {
+    int saved = errno;
+    close(fd);
+    errno = saved;
+    return -1;
+  }
+  return fd;
+}
+
+// Sends the catalog keeping at most LOADGEN_DEPTH lines unanswered, and
+// matches the responses to their lines in order
+static void *run_connection(void *arg) {
+  Connection *conn = arg;
+  const Catalog *catalog = conn->catalog;
+  int fd = connect_socket(conn->path);
+  if (fd == -1) {
+    conn->error = errno;
+    return NULL;
+  }
+
+  char *buffer = malloc(LOADGEN_READ_SIZE);
+  size_t sent_bytes = 0, sent = 0, received = 0;
+  // Bytes of the current response looked at so far, to spot "ERROR:"
+  size_t response_len = 0;
+  bool response_error = true;
+  static const char error_prefix[] = "ERROR:";
+  bool shut = false;
+
+  while (received < catalog->count) {
+    size_t window = received + LOADGEN_DEPTH < catalog->count
+                        ? received + LOADGEN_DEPTH
+                        : catalog->count;
+    size_t window_end = window ? catalog->ends[window - 1] : 0;
+    struct pollfd pfd = {fd, POLLIN, 0};
+    if (sent_bytes < window_end)
+      pfd.events |= POLLOUT;
+    if (poll(&pfd, 1, -1) == -1) {
+      if (errno == EINTR)
+        continue;
+      conn->error = errno;
+      break;
+    }
+    if (pfd.revents & POLLOUT) {
+      ssize_t got = send(fd, catalog->text + sent_bytes,
+                         window_end - sent_bytes, MSG_NOSIGNAL);
+      if (got == -1 && errno != EAGAIN && errno != EINTR) {
+        conn->error = errno;
+        break;
+      }
+      if (got > 0) {
+        sent_bytes += got;
+        double now = util_seconds();
+        while (sent < catalog->count && catalog->ends[sent] <= sent_bytes) {
+          conn->sent_at[sent++] = now;
+        }
+      }
+      // Let the server see EOF once everything is written
+      if (sent == catalog->count && !shut) {
+        shutdown(fd, SHUT_WR);
+        shut = true;
+      }
+    }
+    if (pfd.revents & (POLLIN | POLLHUP | POLLERR)) {
+      ssize_t got = recv(fd, buffer, LOADGEN_READ_SIZE, 0);
+      if (got == -1 && errno != EAGAIN && errno != EINTR) {
+        conn->error = errno;
+        break;
+      }
+      if (got == 0) {
+        conn->error = ECONNRESET;
+        break;
+      }
+      double now = util_seconds();
+      for (ssize_t ix = 0; ix < got; ix++) {
+        if (buffer[ix] == '\n') {
+          // The server rejects an oversized line before it is fully sent,
+          // such a response has no latency
+          if (received < sent)
+            conn->latencies[conn->samples++] =
+                (now - conn->sent_at[received]) * 1e6;
+          if (response_error && response_len >= sizeof(error_prefix) - 1)
+            ++(conn->errors);
+          ++received;
+          response_len = 0;
+          response_error = true;
+        } else {
+          if (response_len < sizeof(error_prefix) - 1 &&
+              buffer[ix] != error_prefix[response_len])
+            response_error = false;
+          ++response_len;
+        }
+      }
+    }
+  }
+  free(buffer);
+  close(fd);
+  return NULL;
+}
+
+static int compare_doubles(const void *a, const void *b) {
+  double x = *(const double *)a, y = *(const double *)b;
+  return (x > y) - (x < y);
+}
+
+// Nearest-rank percentile of sorted values
+static double percentile(const double *sorted, size_t count, double p) {
+  if (!count)
+    return 0;
+  size_t rank = (size_t)ceil(p * count);
+  return sorted[rank ? rank - 1 : 0];
+}
+
+bool loadgen_run(const char *path, FILE *in, int connections,
+                 LoadgenStats *stats) {
+  Catalog catalog;
+  memset(stats, 0, sizeof(*stats));
+  if (!read_catalog(in, &catalog)) {
+    free(catalog.text);
+    free(catalog.ends);
+    return false;
+  }
+
+  size_t total = catalog.count * connections;
+  Connection *conns = calloc(connections, sizeof(Connection));
+  double *sent_at = malloc((total ? total : 1) * sizeof(double));
+  double *latencies = malloc((total ? total : 1) * sizeof(double));
+  double start = util_seconds();
+  for (int ix = 0; ix < connections; ix++) {
+    conns[ix].path = path;
+    conns[ix].catalog = &catalog;
+    conns[ix].sent_at = sent_at + ix * catalog.count;
+    conns[ix].latencies = latencies + ix * catalog.count;
+    pthread_create(&conns[ix].thread, NULL, run_connection, &conns[ix]);
+  }
+
+  int error = 0;
+  size_t samples = 0;
+  for (int ix = 0; ix < connections; ix++) {
+    pthread_join(conns[ix].thread, NULL);
+    stats->errors += conns[ix].errors;
+    if (conns[ix].error)
+      error = conns[ix].error;
+    // Gather the recorded latencies at the front
+    memmove(latencies + samples, conns[ix].latencies,
+            conns[ix].samples * sizeof(double));
+    samples += conns[ix].samples;
+  }
+  stats->seconds = util_seconds() - start;
+
+  if (!error) {
+    stats->requests = total;
+    qsort(latencies, samples, sizeof(double), compare_doubles);
+    stats->p50 = percentile(latencies, samples, 0.50);
+    stats->p99 = percentile(latencies, samples, 0.99);
+    stats->p999 = percentile(latencies, samples, 0.999);
+    stats->max = samples ? latencies[samples - 1] : 0;
+  }
+  free(sent_at);
+  free(latencies);
+  free(conns);
+  free(catalog.text);
+  free(catalog.ends);
+  errno = error;
+  return !error;
+}
+
+void loadgen_print_stats(LoadgenStats *stats) {
+  double rate = stats->seconds > 0 ? stats->requests / stats->seconds : 0;
+  fprintf(stderr,
+          "Sent %ld requests (%ld errors) in %.3f s: %.0f requests/sec\n",
+          stats->requests, stats->errors, stats->seconds, rate);
+  fprintf(stderr,
+          "Latency: p50 %.1f us, p99 %.1f us, p999 %.1f us, max %.1f us\n",
+          stats->p50, stats->p99, stats->p999, stats->max);
+}
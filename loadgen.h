@@ -0,0 +1,45 @@
+#ifndef LOADGEN_H
+#define LOADGEN_H
+
+#include <stdbool.h>
+#include <stdio.h>
+
+/*
+  Load generator for the server. Every connection sends the whole catalog
+  with up to LOADGEN_DEPTH requests in flight, and the time from sending a
+  line to receiving its response is recorded for each request.
+*/
+
+#define LOADGEN_DEPTH 1024
+
+typedef struct loadgen_stats
+{
+  long int requests;
+  long int errors; // "ERROR: ..." responses
+  double seconds;
+  // Latency percentiles in microseconds
+  double p50;
+  double p99;
+  double p999;
+  double max;
+} LoadgenStats;
+
+/**
+ * @brief Replays newline-delimited expressions against a running server.
+ *
+ * @param path The socket path the server listens on.
+ * @param in The stream the expressions are read from, read once and sent
+ *           by every connection.
+ * @param connections The number of concurrent connections, one thread each.
+ * @param stats Receives the request counts, time and latencies.
+ * @return bool false if a connection failed, with errno set.
+ */
+bool loadgen_run(const char *path, FILE *in, int connections,
+                 LoadgenStats *stats);
+
+/**
+ * @brief Prints the throughput and latency summary to stderr.
+ */
+void loadgen_print_stats(LoadgenStats *stats);
+
+#endif
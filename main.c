@@ -42,7 +42,13 @@ https://www.mathblog.dk/tools/infix-postfix-converter/
 For absolute value simply omitted it from the input then added it to the correct
 spot in the generated output
 */
+#include "batch.h"
+#include "bytecode.h"
+#include "fastfloat.h"
+#include "loadgen.h"
 #include "parser.h"
+#include "profile.h"
+#include "server.h"
 #include <ctype.h>
 #include <stdbool.h>
 #include <stdio.h>
@@ -50,16 +56,26 @@ spot in the generated output
 #include <string.h>
 
 
-#define MAX_BUF 1024
-typedef bool (*ParseFunc)(Parser *parser);
+#define DEFAULT_CACHE_MB 64
 
 void print_help();
+void print_profile();
 
 int main(int argc, char *argv[]) {
-  char source[MAX_BUF];
+  // Points at the argument, the sample or the line read from stdin
+  char *source = "";
   bool output_postfix = false;
   bool c_input = false;
   bool sample = false;
+  bool batch = false;
+  char *batch_path = NULL;
+  char *mapped_path = NULL;
+  char *compile_path = NULL;
+  char *bytecode_path = NULL;
+  char *server_path = NULL;
+  char *loadgen_path = NULL;
+  int threads = 1;
+  size_t cache_mb = 0;
   ParseFunc parse_func = parser_parse_infix;
 
   for (int ix = 1; ix < argc && !sample; ix++) {
@@ -75,7 +91,7 @@ int main(int argc, char *argv[]) {
         output_postfix = true;
         parser_debug_mode();
         parse_func = parser_parse_infix;
-        strcpy(source, "(4 + 9/2 - -8)^3 + abs(15 % 4 - 5*2)");
+        source = "(4 + 9/2 - -8)^3 + abs(15 % 4 - 5*2)";
         c_input = true;
         sample = true;
         break;
@@ -85,61 +101,249 @@ int main(int argc, char *argv[]) {
       case 'r':
         parse_func = parser_parse_postfix;
         break;
+      case 'i':
+        parse_func = parser_parse_infix_iterative;
+        break;
+      case 'C':
+        parser_checked_mode();
+        break;
+      case 'P':
+        parser_precise_mode();
+        break;
+      case 'F':
+        parser_float_mode();
+        break;
       case 'd':
         parser_debug_mode();
         break;
+      case 't':
+        // The report goes to stderr, away from the results
+        if (!profile_flag)
+          atexit(print_profile);
+        profile_mode();
+        break;
+      case 'b':
+        batch = true;
+        break;
+      case 'f':
+        if (ix + 1 >= argc) {
+          fprintf(stderr, "-f expects a file path\n");
+          return 1;
+        }
+        mapped_path = argv[++ix];
+        batch = true;
+        break;
+      case 'o':
+        if (ix + 1 >= argc) {
+          fprintf(stderr, "-o expects a bytecode file path\n");
+          return 1;
+        }
+        compile_path = argv[++ix];
+        batch = true;
+        break;
+      case 'x':
+        if (ix + 1 >= argc) {
+          fprintf(stderr, "-x expects a bytecode file path\n");
+          return 1;
+        }
+        bytecode_path = argv[++ix];
+        batch = true;
+        break;
+      case 'S':
+        if (ix + 1 >= argc) {
+          fprintf(stderr, "-S expects a socket path\n");
+          return 1;
+        }
+        server_path = argv[++ix];
+        batch = true;
+        break;
+      case 'L':
+        if (ix + 1 >= argc) {
+          fprintf(stderr, "-L expects a socket path\n");
+          return 1;
+        }
+        loadgen_path = argv[++ix];
+        batch = true;
+        break;
+      case 'j':
+        if (ix + 1 >= argc || (threads = atoi(argv[++ix])) < 1) {
+          fprintf(stderr, "-j expects a positive thread count\n");
+          return 1;
+        }
+        batch = true;
+        break;
+      case 'c':
+        if (!cache_mb)
+          cache_mb = DEFAULT_CACHE_MB;
+        batch = true;
+        break;
+      case 'm':
+        if (ix + 1 >= argc || atol(argv[++ix]) < 1) {
+          fprintf(stderr, "-m expects a cache size in MB\n");
+          return 1;
+        }
+        cache_mb = atol(argv[ix]);
+        batch = true;
+        break;
+      case 'E':
+        if (ix + 1 >= argc || !parser_set_engine(argv[++ix])) {
+          fprintf(stderr, "-E expects an engine: stack, threaded or jit\n");
+          return 1;
+        }
+        break;
       default:
         fprintf(stderr, "Unkown command %s\n", argv[ix]);
         return 1;
         break;
       }
+    } else if (batch) {
+      batch_path = argv[ix];
     } else {
-      strcpy(source, argv[ix]);
+      source = argv[ix];
       c_input = true;
     }
   }
 
-  if (!c_input) {
-    fgets(source, MAX_BUF, stdin);
+  if (batch) {
+    BatchOptions options = {parse_func, threads, cache_mb << 20};
+    BatchStats stats;
+    if (server_path) {
+      if (threads != 1) {
+        fprintf(stderr, "-S serves on one thread and cannot be used with -j\n");
+        return 1;
+      }
+      if (!server_run(server_path, &options, &stats)) {
+        perror(server_path);
+        return 1;
+      }
+      batch_print_stats(&stats);
+      return 0;
+    }
+    if (bytecode_path) {
+      int bytecode_err;
+      Bytecode *bytecode = bytecode_open(bytecode_path, &bytecode_err);
+      if (!bytecode) {
+        fprintf(stderr, "%s: %s\n", bytecode_path,
+                bytecode_error_string(bytecode_err));
+        return 1;
+      }
+      bytecode_run(bytecode, stdout, &options, &stats);
+      batch_print_stats(&stats);
+      bytecode_close(bytecode);
+      return 0;
+    }
+    if (mapped_path) {
+      if (!batch_run_mapped(mapped_path, stdout, &options, &stats)) {
+        perror(mapped_path);
+        return 1;
+      }
+      batch_print_stats(&stats);
+      return 0;
+    }
+
+    FILE *in = stdin;
+    if (batch_path && !(in = fopen(batch_path, "r"))) {
+      perror(batch_path);
+      return 1;
+    }
+    if (loadgen_path) {
+      // -j sets the number of connections
+      LoadgenStats load_stats;
+      if (!loadgen_run(loadgen_path, in, threads, &load_stats)) {
+        perror(loadgen_path);
+        return 1;
+      }
+      loadgen_print_stats(&load_stats);
+    } else if (compile_path) {
+      // big_number literals live in the parser, not in the instructions
+      if (parser_precise_flag && !parser_float_flag) {
+        fprintf(stderr, "-o cannot store -P literals\n");
+        return 1;
+      }
+      if (!bytecode_compile(in, compile_path, parse_func, &stats)) {
+        perror(compile_path);
+        return 1;
+      }
+      fprintf(stderr, "Compiled %ld expressions (%ld errors) in %.3f s\n",
+              stats.expressions, stats.errors, stats.seconds);
+    } else {
+      batch_run(in, stdout, &options, &stats);
+      batch_print_stats(&stats);
+    }
+    if (in != stdin)
+      fclose(in);
+    return 0;
+  }
+
+  char *line = NULL;
+  size_t line_cap = 0;
+  if (!c_input && getline(&line, &line_cap, stdin) != -1) {
+    source = line;
   }
 
-  Parser *parser = parser_new(source);
+  Parser *parser = parser_new(source, strlen(source));
   bool valid = parse_func(parser);
-  int err = 0;
+  int err = 0, status = 0;
   if (valid) {
-    long int res = parser_evaluate(parser, &err);
-    if (err) {
-      switch (err) {
-      case INVALID_EXPRESSION:
-        fprintf(stderr, "ERROR: Invalid Expression\n");
-        break;
-      case MISSING_OPERAND:
-        fprintf(stderr, "ERROR: Missing Operand(s)\n");
-        break;
-      case MISSING_OPERATOR:
-        fprintf(stderr, "ERROR: Missing Operator(s)\n");
-        break;
-      }
+    int unoptimized_len, optimized_len;
+    parser_instructions(parser, &unoptimized_len);
+    // Show the postfix form of the input before it gets folded
+    if (output_postfix)
+      parser_output_postfix(parser);
+    // The optimizer folds in long int arithmetic, and the debug trace is
+    // meant to show every step of the original instructions
+    if (!parser_precise_flag && !parser_float_flag && !parser_debug_flag)
+      parser_optimize(parser);
+    parser_instructions(parser, &optimized_len);
+    if (output_postfix) {
+      printf("Instructions: %d -> %d after optimization\n", unoptimized_len,
+             optimized_len);
+      int operations, unique_operations;
+      parser_subexpressions(parser, &operations, &unique_operations);
+      if (unique_operations > 0)
+        printf("Operations: %d -> %d distinct, %.2fx dedup ratio\n",
+               operations, unique_operations,
+               (double)operations / unique_operations);
+    }
 
-      parser_free(parser);
-      return 1;
+    long int res = 0;
+    char *text = NULL;
+    char real_text[FASTFLOAT_FORMAT_LEN];
+    if (parser_float_flag) {
+      fastfloat_format(parser_evaluate_real(parser, &err), real_text);
+      text = real_text;
+    } else if (parser_precise_flag) {
+      text = parser_evaluate_precise(parser, &err);
+    } else {
+      res = parser_evaluate(parser, &err);
+    }
+    if (err) {
+      fprintf(stderr, "ERROR: %s\n", parser_error_string(err));
+      status = 1;
+    } else if (text) {
+      printf("Result: %s\n", text);
+      if (text != real_text)
+        free(text);
     } else {
-      if (output_postfix)
-        parser_output_postfix(parser);
-
       printf("Result: %ld\n", res);
     }
 
+  } else if (parser_parse_error(parser) != INVALID_EXPRESSION) {
+    fprintf(stderr, "ERROR: %s\n",
+            parser_error_string(parser_parse_error(parser)));
+    status = 1;
   } else {
     fprintf(stderr, "Invalid expression\n");
-    parser_free(parser);
-    return 1;
+    status = 1;
   }
   parser_free(parser);
-  return 0;
+  free(line);
+  return status;
 }
 
 
+void print_profile() { profile_report(stderr); }
+
 void print_help()
 {
   printf("************************************************\n"
@@ -150,9 +354,24 @@ void print_help()
          "**--------------------------------------------**\n"
          "** -h......................Displays Help Menu **\n"
          "** -d....................Toggles Debug Output **\n"
+         "** -t.............JSON timing profile at exit **\n"
          "** -v..................Display Postfix Result **\n"
          "** -r....................Set input to PostFix **\n"
+         "** -i...........Parse infix without recursion **\n"
          "** -s......Tests all operations with a sample **\n"
+         "** -b [file].........Evaluates lines in batch **\n"
+         "** -f file...........Batch over a mapped file **\n"
+         "** -o file [in].....Compile lines to bytecode **\n"
+         "** -x file...........Evaluate a bytecode file **\n"
+         "** -S path.......Serve lines on a Unix socket **\n"
+         "** -L path [in].........Load test a -S server **\n"
+         "** -j N...........Batch with N worker threads **\n"
+         "** -c..................Cache results in batch **\n"
+         "** -m MB..............Cap the cache at MB MiB **\n"
+         "** -C..........Report overflow and x/0 errors **\n"
+         "** -P..........Exact arbitrary-precision mode **\n"
+         "** -F.............Double precision float mode **\n"
+         "** -E engine.....Engine: stack, threaded, jit **\n"
          "**--------------------------------------------**\n"
          "**                  Operators                 **\n"
          "**--------------------------------------------**\n"
@@ -0,0 +1,298 @@
+#include "optimizer.h"
+#include "arith.h"
+#include <limits.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+// What the optimizer knows about one value on the evaluation stack
+typedef struct entry {
+  int start; // first output instruction computing the value
+  bool constant;
+  long int value;
+} Entry;
+
+// One distinct subexpression of the DAG
+typedef struct node {
+  Instruction instruction;
+  int operands[2]; // Nodes of the operands, -1 where there are none
+  int uses;        // Parents referring to the node, plus one for the root
+  int temp;        // Temporary holding the value once computed, -1 before
+  int next;        // Next node in the same hash bucket
+} Node;
+
+// A node being emitted and how many of its operands are done
+typedef struct frame {
+  int node;
+  int done;
+} Frame;
+
+// Computes a op b exactly as the evaluator would
+// Returns false for operations that would overflow, trap or fail at run
+// time, which are left for the evaluator to wrap or report
+static bool fold(TokenType opcode, long int a, long int b, long int *result) {
+  switch (opcode) {
+  case add:
+    return arith_add(a, b, result) == VALID;
+  case sub:
+    return arith_sub(a, b, result) == VALID;
+  case mul:
+    return arith_mul(a, b, result) == VALID;
+  case divide:
+    return arith_div(a, b, result) == VALID;
+  case mod:
+    // Unchecked, LONG_MIN % -1 traps rather than giving 0
+    return !(a == LONG_MIN && b == -1) && arith_mod(a, b, result) == VALID;
+  case power:
+    return arith_pow(a, b, result) == VALID;
+  default:
+    return false;
+  }
+}
+
+// x op b == x for every x
+static bool right_identity(TokenType opcode, long int b) {
+  return (b == 0 && (opcode == add || opcode == sub)) ||
+         (b == 1 && (opcode == mul || opcode == divide || opcode == power));
+}
+
+// a op x == x for every x
+static bool left_identity(TokenType opcode, long int a) {
+  return (a == 0 && opcode == add) || (a == 1 && opcode == mul);
+}
+
+static int arity(TokenType opcode) {
+  if (opcode == number || opcode == variable)
+    return 0;
+  if (opcode == absolute || (opcode >= add_imm && opcode <= power_imm))
+    return 1;
+  if (opcode >= add && opcode <= power)
+    return 2;
+  return -1;
+}
+
+static size_t hash_node(const Instruction *instruction, const int *operands) {
+  uint64_t hash = (uint64_t)instruction->opcode * 0x9E3779B97F4A7C15ULL;
+  hash = (hash ^ (uint64_t)instruction->value) * 0xBF58476D1CE4E5B9ULL;
+  hash = (hash ^ (uint32_t)operands[0]) * 0x94D049BB133111EBULL;
+  hash = (hash ^ (uint32_t)operands[1]) * 0x9E3779B97F4A7C15ULL;
+  return hash ^ (hash >> 31);
+}
+
+// Hash-conses postfix code into nodes, so equal subexpressions get the same
+// node. Returns the root, or -1 if the code is not one whole expression.
+static int build_dag(const Instruction *code, int len, Node *nodes,
+                     int *node_count) {
+  size_t mask = 1;
+  while (mask < (size_t)len * 2) {
+    mask <<= 1;
+  }
+  int *buckets = malloc(mask * sizeof(int));
+  int *stack = malloc((len + 1) * sizeof(int));
+  int depth = 0, root = -1;
+  memset(buckets, -1, mask * sizeof(int));
+  --mask;
+  *node_count = 0;
+
+  for (int ix = 0; ix < len; ix++) {
+    int count = arity(code[ix].opcode);
+    if (count < 0 || depth < count)
+      goto done;
+    int operands[2] = {-1, -1};
+    for (int op = count - 1; op >= 0; op--) {
+      operands[op] = stack[--depth];
+    }
+
+    size_t bucket = hash_node(&code[ix], operands) & mask;
+    int found = buckets[bucket];
+    while (found >= 0 && !(nodes[found].instruction.opcode == code[ix].opcode &&
+                           nodes[found].instruction.value == code[ix].value &&
+                           nodes[found].operands[0] == operands[0] &&
+                           nodes[found].operands[1] == operands[1])) {
+      found = nodes[found].next;
+    }
+    if (found < 0) {
+      // Only a new node refers to its operands, a found one already does
+      found = (*node_count)++;
+      Node *node = &nodes[found];
+      node->instruction = code[ix];
+      node->operands[0] = operands[0];
+      node->operands[1] = operands[1];
+      node->uses = 0;
+      node->temp = -1;
+      node->next = buckets[bucket];
+      buckets[bucket] = found;
+      for (int op = 0; op < count; op++) {
+        ++(nodes[operands[op]].uses);
+      }
+    }
+    stack[depth++] = found;
+  }
+  if (depth == 1) {
+    root = stack[0];
+    ++(nodes[root].uses);
+  }
+
+done:
+  free(stack);
+  free(buckets);
+  return root;
+}
+
+// Emits the DAG in postfix order with each node computed once. Operations
+// with several parents are stored to a temporary when first computed and
+// loaded after that, as long as temporaries remain.
+static int emit_dag(Node *nodes, int node_count, int root, Instruction *out) {
+  // Deep expressions are walked with an explicit stack, not recursion
+  Frame *stack = malloc((node_count + 1) * sizeof(Frame));
+  int depth = 0, out_len = 0, temps = 0;
+  stack[depth].node = root;
+  stack[depth++].done = 0;
+
+  while (depth > 0) {
+    Frame *frame = &stack[depth - 1];
+    Node *node = &nodes[frame->node];
+    if (node->temp >= 0) {
+      out[out_len].opcode = load_temp;
+      out[out_len++].value = node->temp;
+      --depth;
+    } else if (frame->done < 2 && node->operands[frame->done] >= 0) {
+      stack[depth].node = node->operands[frame->done++];
+      stack[depth++].done = 0;
+    } else {
+      out[out_len++] = node->instruction;
+      if (node->uses > 1 && node->operands[0] >= 0 && temps < MAX_TEMPS) {
+        node->temp = temps++;
+        out[out_len].opcode = store_temp;
+        out[out_len++].value = node->temp;
+      }
+      --depth;
+    }
+  }
+  free(stack);
+  return out_len;
+}
+
+// Rewrites code so every repeated operation is computed once
+static int share_common(Instruction *code, int len, OptimizerStats *stats) {
+  Node *nodes = malloc((len + 1) * sizeof(Node));
+  int node_count;
+  int root = build_dag(code, len, nodes, &node_count);
+  if (root < 0) {
+    free(nodes);
+    return len;
+  }
+  if (stats) {
+    stats->unique_operations = 0;
+    for (int ix = 0; ix < node_count; ix++) {
+      stats->unique_operations += nodes[ix].operands[0] >= 0;
+    }
+  }
+
+  bool shared = false;
+  for (int ix = 0; ix < node_count && !shared; ix++) {
+    shared = nodes[ix].uses > 1 && nodes[ix].operands[0] >= 0;
+  }
+  // Sharing never lengthens the code: k copies of an n instruction
+  // operation become n + k instructions
+  if (shared) {
+    Instruction *out = malloc((len + 1) * sizeof(Instruction));
+    len = emit_dag(nodes, node_count, root, out);
+    memcpy(code, out, len * sizeof(Instruction));
+    free(out);
+  }
+  free(nodes);
+  return len;
+}
+
+int optimizer_run(Instruction *code, int len, OptimizerStats *stats) {
+  Instruction *out = malloc((len + 1) * sizeof(Instruction));
+  Entry *stack = malloc((len + 1) * sizeof(Entry));
+  int out_len = 0, depth = 0;
+  bool valid = true;
+
+  for (int ix = 0; ix < len && valid; ix++) {
+    TokenType opcode = code[ix].opcode;
+    long int value = code[ix].value;
+
+    // Already fused operators are unfused and optimized again
+    if (opcode >= add_imm && opcode <= power_imm) {
+      stack[depth].start = out_len;
+      stack[depth].constant = true;
+      stack[depth++].value = value;
+      out[out_len].opcode = number;
+      out[out_len++].value = value;
+      opcode = add + (opcode - add_imm);
+    }
+
+    if (opcode == number || opcode == variable) {
+      stack[depth].start = out_len;
+      stack[depth].constant = opcode == number;
+      stack[depth++].value = value;
+      out[out_len++] = code[ix];
+    } else if (opcode == absolute) {
+      if (depth < 1) {
+        valid = false;
+        break;
+      }
+      Entry *top = &stack[depth - 1];
+      if (top->constant && arith_abs(top->value, &top->value) == VALID) {
+        out_len = top->start;
+        out[out_len].opcode = number;
+        out[out_len++].value = top->value;
+      } else {
+        out[out_len++] = code[ix];
+        top->constant = false;
+      }
+    } else if (opcode >= add && opcode <= power) {
+      if (depth < 2) {
+        valid = false;
+        break;
+      }
+      Entry *a = &stack[depth - 2], *b = &stack[depth - 1];
+      long int result;
+      if (a->constant && b->constant && fold(opcode, a->value, b->value, &result)) {
+        a->value = result;
+        out_len = a->start;
+        out[out_len].opcode = number;
+        out[out_len++].value = result;
+      } else if (b->constant && right_identity(opcode, b->value)) {
+        out_len = b->start;
+      } else if (a->constant && left_identity(opcode, a->value)) {
+        // Drop the push of a, b's code slides down into its place
+        memmove(&out[a->start], &out[a->start + 1],
+                (out_len - a->start - 1) * sizeof(Instruction));
+        --out_len;
+        a->constant = false;
+      } else if (b->constant) {
+        out_len = b->start;
+        out[out_len].opcode = add_imm + (opcode - add);
+        out[out_len++].value = b->value;
+        a->constant = false;
+      } else {
+        out[out_len].opcode = opcode;
+        out[out_len++].value = 0;
+        a->constant = false;
+      }
+      --depth;
+    } else {
+      valid = false;
+    }
+  }
+
+  if (valid) {
+    memcpy(code, out, out_len * sizeof(Instruction));
+    len = out_len;
+  }
+  free(stack);
+  free(out);
+
+  if (stats) {
+    stats->operations = 0;
+    for (int ix = 0; ix < len; ix++) {
+      stats->operations += arity(code[ix].opcode) > 0;
+    }
+    stats->unique_operations = stats->operations;
+  }
+  return valid ? share_common(code, len, stats) : len;
+}
@@ -0,0 +1,38 @@
+#ifndef OPTIMIZER_H
+#define OPTIMIZER_H
+
+#include "parser.h"
+
+// Only operations count, numbers and variables are leaves that cost nothing
+// to repeat
+typedef struct optimizer_stats
+{
+  int operations;        // Operator instructions in the folded code
+  int unique_operations; // Distinct ones, each evaluated once while
+                         // MAX_TEMPS temporaries last
+} OptimizerStats;
+
+/**
+ * @brief Optimizes an instruction stream in place.
+ *
+ * Folds operators whose operands are all constant, drops identity
+ * operations (x + 0, x - 0, x * 1, x / 1, x ^ 1, 0 + x, 1 * x) and fuses a
+ * number followed by a binary operator into that operator's *_imm form.
+ * Code that would fail (underflow, unknown opcodes) is left untouched so
+ * the evaluator still reports the same error, and operations that would
+ * trap at run time, such as division by zero, are never folded.
+ *
+ * The folded code is then hash-consed into a DAG of subexpressions. Each
+ * distinct one is computed once: the first copy of a repeated operation
+ * is kept with store_temp and the later copies become load_temp. The
+ * first copy is always the first evaluated, so errors are reported at
+ * the same point as before.
+ *
+ * @param code The instructions to optimize.
+ * @param len The number of instructions.
+ * @param stats Receives the operation counts, may be NULL.
+ * @return int The number of instructions after optimization.
+ */
+int optimizer_run(Instruction *code, int len, OptimizerStats *stats);
+
+#endif
@@ -1,66 +1,220 @@
 #include "parser.h"
+#include "arith.h"
+#include "fastfloat.h"
+#include "optimizer.h"
+#include "precise.h"
+#include "profile.h"
+#include "real.h"
 #include "stack.h"
+#include "threaded.h"
+#include "verify.h"
 #include <ctype.h>
-#include <math.h>
+#include <limits.h>
 #include <stdlib.h>
+#include <string.h>
 
-#define MAXLEN 4096
+// Instructions allocated up front, the buffer doubles from there
+#define INITIAL_CODE_CAPACITY 16
+// Longest instruction stream a parse may emit, lengths are ints
+#define MAX_CODE_LEN (INT_MAX / 2)
 #define IGNORE_VALUE 0
+// Verified programs up to this deep evaluate on the C stack
+#define LOCAL_STACK_DEPTH 64
 int parser_debug_flag = 0;
-
-typedef struct instruction {
-  TokenType opcode;
-  long int value;
-} Instruction;
+int parser_engine = ENGINE_STACK;
+int parser_checked_flag = 0;
+int parser_precise_flag = 0;
+int parser_float_flag = 0;
 
 struct parser {
   Lexer *lexer;
-  Instruction compiled[MAXLEN];
+  Instruction *compiled;
   int compiled_len;
+  int compiled_cap;
+  int parse_error; // parser_errors code of a failed parse, VALID otherwise
+  // Variable names point into the source being parsed
+  const char *variables[MAX_VARIABLES];
+  size_t variable_lens[MAX_VARIABLES];
+  int variable_count;
+  // Tokens of the big_number literals, indexed by the instruction value
+  Token *literals;
+  int literal_count;
+  int literal_cap;
+  int max_depth;      // Stack depth of the compiled code, see verify_program
+  bool checked;       // parser_checked_flag when the code was compiled
+  int operations;        // Operators in the code parser_optimize folded
+  int unique_operations; // Distinct ones among them
+  uint64_t lex_ticks; // Time spent in the lexer by the parse, when profiling
 };
 
 // Return false if operation is unsucessful
-typedef bool (*StackOperationFunc)(Stack *stack, long int value, int *error);
-char *tokens_as_strings[] = {"+ ", "- ", "* ", "/ ", "% ", "^ ", "abs ", ""};
-char *tokens_by_name[] = {"ADD", "SUB", "MUL", "DIV",
-                          "MOD", "POW", "ABS", "NONE"};
-
-bool stackop_add(Stack *stack, long int value, int *error);
-bool stackop_sub(Stack *stack, long int value, int *error);
-bool stackop_mul(Stack *stack, long int value, int *error);
-bool stackop_div(Stack *stack, long int value, int *error);
-bool stackop_mod(Stack *stack, long int value, int *error);
-bool stackop_pow(Stack *stack, long int value, int *error);
-bool stackop_abs(Stack *stack, long int value, int *error);
-bool stackop_push_num(Stack *stack, long int value, int *error);
+// Only stackop_push_num uses value, the operators pop their operands.
+// checked selects checked arithmetic, see parser_checked_mode.
+typedef bool (*StackOperationFunc)(Stack *stack, long int value, bool checked,
+                                   int *error);
+char *tokens_as_strings[] = {"+ ", "- ", "* ", "/ ", "% ", "^ ", "abs ", "", ""};
+char *tokens_by_name[] = {"ADD", "SUB", "MUL", "DIV", "MOD",
+                          "POW", "ABS", "NONE", "LOAD"};
+
+bool stackop_add(Stack *stack, long int value, bool checked, int *error);
+bool stackop_sub(Stack *stack, long int value, bool checked, int *error);
+bool stackop_mul(Stack *stack, long int value, bool checked, int *error);
+bool stackop_div(Stack *stack, long int value, bool checked, int *error);
+bool stackop_mod(Stack *stack, long int value, bool checked, int *error);
+bool stackop_pow(Stack *stack, long int value, bool checked, int *error);
+bool stackop_abs(Stack *stack, long int value, bool checked, int *error);
+bool stackop_push_num(Stack *stack, long int value, bool checked,
+                      int *error);
 
 // Testing 1 more thing
 bool calculate_internal(Stack **stack, TokenType type, int *error);
 
 // Position is same as the TokenType enum that we also use for opcodes
-// Used in the evaluator
+// Used in the evaluator, variables are resolved to their binding and pushed
 StackOperationFunc stack_operation_table[] = {
-    stackop_add, stackop_sub, stackop_mul, stackop_div,
-    stackop_mod, stackop_pow, stackop_abs, stackop_push_num};
+    stackop_add, stackop_sub, stackop_mul, stackop_div, stackop_mod,
+    stackop_pow, stackop_abs, stackop_push_num, stackop_push_num};
 
-Parser *parser_new(char *buf) {
+Parser *parser_new(const char *src, size_t len) {
   Parser *new_parser = malloc(sizeof(Parser));
-  new_parser->lexer = lexer_new(buf);
+  new_parser->lexer = lexer_new(src, len);
+  new_parser->compiled = malloc(INITIAL_CODE_CAPACITY * sizeof(Instruction));
   new_parser->compiled_len = 0;
+  new_parser->compiled_cap = new_parser->compiled ? INITIAL_CODE_CAPACITY : 0;
+  new_parser->parse_error = VALID;
+  new_parser->variable_count = 0;
+  new_parser->literals = NULL;
+  new_parser->literal_count = 0;
+  new_parser->literal_cap = 0;
+  new_parser->max_depth = 0;
+  new_parser->checked = false;
+  new_parser->operations = 0;
+  new_parser->unique_operations = 0;
+  new_parser->lex_ticks = 0;
 
   return new_parser;
 }
 
 void parser_free(Parser *parser) {
   lexer_free(parser->lexer);
+  free(parser->compiled);
+  free(parser->literals);
   free(parser);
 }
 
-void emit(Parser *parser, TokenType opcode, int val) {
+// Returns false if the instruction buffer cannot grow to fit another one
+bool emit(Parser *parser, TokenType opcode, long int val) {
+  if (parser->compiled_len == parser->compiled_cap) {
+    int capacity = parser->compiled_cap ? parser->compiled_cap * 2
+                                        : INITIAL_CODE_CAPACITY;
+    Instruction *grown = NULL;
+    if (parser->compiled_cap < MAX_CODE_LEN)
+      grown = realloc(parser->compiled, capacity * sizeof(Instruction));
+    if (!grown) {
+      parser->parse_error = OUT_OF_MEMORY;
+      return false;
+    }
+    parser->compiled = grown;
+    parser->compiled_cap = capacity;
+  }
   parser->compiled[parser->compiled_len].opcode = opcode;
   parser->compiled[parser->compiled_len].value = val;
 
   ++(parser->compiled_len);
+  return true;
+}
+
+// Returns the slot of the named variable, assigning the next free one
+// Returns -1 if there are too many variables
+int variable_slot(Parser *parser, const char *name, size_t len) {
+  for (int ix = 0; ix < parser->variable_count; ix++) {
+    if (parser->variable_lens[ix] == len &&
+        !strncmp(parser->variables[ix], name, len))
+      return ix;
+  }
+  if (parser->variable_count == MAX_VARIABLES)
+    return -1;
+
+  parser->variables[parser->variable_count] = name;
+  parser->variable_lens[parser->variable_count] = len;
+  return (parser->variable_count)++;
+}
+
+bool emit_variable(Parser *parser, Token *tok) {
+  int slot = variable_slot(parser, lexer_token_text(parser->lexer, tok),
+                           tok->len);
+  if (slot < 0)
+    return false;
+  return emit(parser, variable, slot);
+}
+
+// Keeps the token of a literal too large for a long int, returns its index
+// or -1 if the table cannot grow
+static int add_literal(Parser *parser, Token *tok) {
+  if (parser->literal_count == parser->literal_cap) {
+    int capacity = parser->literal_cap ? parser->literal_cap * 2 : 4;
+    Token *grown = realloc(parser->literals, capacity * sizeof(Token));
+    if (!grown)
+      return -1;
+    parser->literals = grown;
+    parser->literal_cap = capacity;
+  }
+  parser->literals[parser->literal_count] = *tok;
+  return (parser->literal_count)++;
+}
+
+// Literals that do not fit in a long int fail the parse, unless precise mode
+// keeps them as big_number instructions
+bool emit_number(Parser *parser, Token *tok) {
+  if (parser_float_flag)
+    return emit(parser, number, real_to_bits(tok->real));
+  if (!tok->overflow)
+    return emit(parser, number, tok->value);
+  if (!parser_precise_flag) {
+    parser->parse_error = NUMBER_OVERFLOW;
+    return false;
+  }
+  int index = add_literal(parser, tok);
+  if (index < 0) {
+    parser->parse_error = OUT_OF_MEMORY;
+    return false;
+  }
+  return emit(parser, big_number, index);
+}
+
+// Moves to the next token, timing the lexer while profiling
+static inline void advance(Parser *parser) {
+  if (!profile_flag) {
+    lexer_advance_token(parser->lexer);
+    return;
+  }
+  uint64_t start = profile_clock();
+  lexer_advance_token(parser->lexer);
+  parser->lex_ticks += profile_clock() - start;
+}
+
+// Runs a parse and verifies the stack effects of the code it emitted, so
+// malformed postfix input fails here with a precise error. While profiling,
+// lexing and the rest of the parse are recorded as separate phases.
+static bool compile(Parser *parser, ParseFunc parse) {
+  uint64_t start = 0;
+  if (profile_flag) {
+    parser->lex_ticks = 0;
+    start = profile_clock();
+  }
+  bool valid = parse(parser);
+  parser->checked = parser_checked_flag;
+  if (valid) {
+    parser->parse_error = verify_program(parser->compiled, parser->compiled_len,
+                                         &parser->max_depth);
+    valid = parser->parse_error == VALID;
+  }
+  if (profile_flag) {
+    uint64_t ticks = profile_clock() - start;
+    profile_record(PHASE_LEX, parser->lex_ticks);
+    profile_record(PHASE_PARSE, ticks - parser->lex_ticks);
+  }
+  return valid;
 }
 
 bool p_expression(Parser *parser);
@@ -69,9 +223,9 @@ bool p_exp(Parser *parser);
 bool p_factor(Parser *parser);
 bool p_group(Parser *parser);
 
-bool parser_parse_infix(Parser *parser) {
+static bool parse_infix(Parser *parser) {
 
-  lexer_advance_token(parser->lexer);
+  advance(parser);
   bool valid = p_expression(parser);
   if (lexer_get_token(parser->lexer)->type != end) {
     valid = false;
@@ -80,6 +234,10 @@ bool parser_parse_infix(Parser *parser) {
   return valid;
 }
 
+bool parser_parse_infix(Parser *parser) {
+  return compile(parser, parse_infix);
+}
+
 bool p_expression(Parser *parser) {
   if (parser_debug_flag) {
     fprintf(stderr, "[PARSER] expression ::= term ( ('+'|'-') term )*\n");
@@ -91,10 +249,10 @@ bool p_expression(Parser *parser) {
   }
   while (valid && (tok->type == add || tok->type == sub)) {
     TokenType opcode = tok->type;
-    lexer_advance_token(parser->lexer);
+    advance(parser);
     valid = p_term(parser);
     if (valid) {
-      emit(parser, opcode, IGNORE_VALUE);
+      valid = emit(parser, opcode, IGNORE_VALUE);
     }
     //update token for while loop
     tok = lexer_get_token(parser->lexer);
@@ -115,10 +273,10 @@ bool p_term(Parser *parser) {
   while (valid &&
          (tok->type == mul || tok->type == divide || tok->type == mod)) {
     TokenType opcode = tok->type;
-    lexer_advance_token(parser->lexer);
+    advance(parser);
     valid = p_exp(parser);
     if (valid) {
-      emit(parser, opcode, IGNORE_VALUE);
+      valid = emit(parser, opcode, IGNORE_VALUE);
     }
     //update token for while loop
     tok = lexer_get_token(parser->lexer);
@@ -138,10 +296,10 @@ bool p_exp(Parser *parser) {
   }
   if (valid && tok->type == power) {
     TokenType opcode = tok->type;
-    lexer_advance_token(parser->lexer);
+    advance(parser);
     valid = p_exp(parser);
     if (valid) {
-      emit(parser, opcode, IGNORE_VALUE);
+      valid = emit(parser, opcode, IGNORE_VALUE);
     }
   }
   return valid;
@@ -150,61 +308,394 @@ bool p_exp(Parser *parser) {
 bool p_factor(Parser *parser) {
   if (parser_debug_flag)
     fprintf(stderr, "[PARSER] factor ::= '(' expression ')' | NUMBER | "
-                    "'abs''(' expression ')'\n");
+                    "VARIABLE | 'abs''(' expression ')'\n");
 
   Token *tok = lexer_get_token(parser->lexer);
   bool valid = true;
   if (tok->type == left_paren) {
-    lexer_advance_token(parser->lexer);
+    advance(parser);
     valid = p_expression(parser);
     tok = lexer_get_token(parser->lexer);
     if (tok->type == right_paren) {
-      lexer_advance_token(parser->lexer);
+      advance(parser);
     } else {
       valid = false;
     }
   } else if (tok->type == number) {
     if (parser_debug_flag)
-      fprintf(stderr, "[PARSER] Number Found: %s\n", tok->buf);
-    emit(parser, number, atol(tok->buf));
-    lexer_advance_token(parser->lexer);
+      fprintf(stderr, "[PARSER] Number Found: %.*s\n", (int)tok->len,
+              lexer_token_text(parser->lexer, tok));
+    valid = emit_number(parser, tok);
+    advance(parser);
+  } else if (tok->type == variable) {
+    if (parser_debug_flag)
+      fprintf(stderr, "[PARSER] Variable Found: %.*s\n", (int)tok->len,
+              lexer_token_text(parser->lexer, tok));
+    valid = emit_variable(parser, tok);
+    advance(parser);
   }else if(tok->type == absolute){
     TokenType opcode = tok->type;
-    lexer_advance_token(parser->lexer);
+    advance(parser);
     valid = p_factor(parser);
     if(!valid)
       return valid;
-    emit(parser, opcode, IGNORE_VALUE);
+    valid = emit(parser, opcode, IGNORE_VALUE);
   } else {
     valid = false;
   }
   return valid;
 }
 
+// Binding power of a binary operator, 0 for every other token
+static int precedence(TokenType type) {
+  switch (type) {
+  case add:
+  case sub:
+    return 1;
+  case mul:
+  case divide:
+  case mod:
+    return 2;
+  case power:
+    return 3;
+  default:
+    return 0;
+  }
+}
+
+// A factor just ended, emit the abs operators that were waiting on it
+static bool close_factor(Parser *parser, Stack *pending) {
+  int err = 0;
+  bool valid = true;
+  while (valid && !stack_empty(pending) &&
+         stack_peek(pending, &err) == absolute) {
+    valid = emit(parser, stack_pop(pending, &err), IGNORE_VALUE);
+  }
+  return valid;
+}
+
+// Returns false if the pending operators cannot grow to fit another one
+static bool push_pending(Parser *parser, Stack *pending, TokenType type) {
+  if (stack_push(pending, type))
+    return true;
+  parser->parse_error = OUT_OF_MEMORY;
+  return false;
+}
+
+// Shunting-yard over the same grammar as p_expression. Operators, '(' and
+// 'abs' wait on a heap stack instead of the C stack, so nesting depth is
+// bounded only by memory.
+static bool parse_infix_iterative(Parser *parser) {
+  Stack *pending = stack_create();
+  if (!pending) {
+    parser->parse_error = OUT_OF_MEMORY;
+    return false;
+  }
+  bool expect_operand = true;
+  bool valid = true;
+  int err = 0;
+
+  advance(parser);
+  for (;;) {
+    Token *tok = lexer_get_token(parser->lexer);
+    TokenType type = tok->type;
+    if (expect_operand) {
+      if (type == left_paren || type == absolute) {
+        valid = push_pending(parser, pending, type);
+      } else if (type == number || type == variable) {
+        if (parser_debug_flag)
+          fprintf(stderr, "[PARSER] Operand Found: %.*s\n", (int)tok->len,
+                  lexer_token_text(parser->lexer, tok));
+        if (type == number)
+          valid = emit_number(parser, tok);
+        else
+          valid = emit_variable(parser, tok);
+        valid = valid && close_factor(parser, pending);
+        expect_operand = false;
+      } else {
+        valid = false;
+      }
+    } else if (precedence(type)) {
+      // Everything binding tighter is complete, '^' is right associative
+      while (valid && !stack_empty(pending)) {
+        int top = precedence(stack_peek(pending, &err));
+        if (top < precedence(type) || (top == precedence(type) && type == power))
+          break;
+        valid = emit(parser, stack_pop(pending, &err), IGNORE_VALUE);
+      }
+      valid = valid && push_pending(parser, pending, type);
+      expect_operand = true;
+    } else if (type == right_paren) {
+      while (valid && !stack_empty(pending) &&
+             stack_peek(pending, &err) != left_paren) {
+        valid = emit(parser, stack_pop(pending, &err), IGNORE_VALUE);
+      }
+      // An unmatched ')' ends the expression early like in p_expression
+      if (stack_empty(pending)) {
+        valid = false;
+      } else {
+        stack_pop(pending, &err);
+        valid = valid && close_factor(parser, pending);
+      }
+    } else if (type == end) {
+      while (valid && !stack_empty(pending)) {
+        TokenType opcode = stack_pop(pending, &err);
+        valid = opcode != left_paren && emit(parser, opcode, IGNORE_VALUE);
+      }
+      break;
+    } else {
+      valid = false;
+    }
+
+    if (!valid)
+      break;
+    advance(parser);
+  }
+
+  stack_free(pending);
+  return valid;
+}
+
+bool parser_parse_infix_iterative(Parser *parser) {
+  return compile(parser, parse_infix_iterative);
+}
+
 long int parser_evaluate(Parser *parser, int *error) {
-  long int v1, v2;
+  if (parser->parse_error) {
+    *error = parser->parse_error;
+    return 0;
+  }
+  uint64_t start = profile_flag ? profile_clock() : 0;
+  long int result =
+      parser_execute_verified(parser->compiled, parser->compiled_len,
+                              parser->max_depth, parser->checked, NULL, error);
+  if (profile_flag)
+    profile_evaluated(parser->compiled, parser->compiled_len, start, *error);
+  return result;
+}
+
+char *parser_evaluate_precise(Parser *parser, int *error) {
+  if (parser->parse_error) {
+    *error = parser->parse_error;
+    return NULL;
+  }
+  uint64_t start = profile_flag ? profile_clock() : 0;
+  BigNum **literals = malloc((parser->literal_count + 1) * sizeof(BigNum *));
+  for (int ix = 0; ix < parser->literal_count; ix++) {
+    Token *tok = &parser->literals[ix];
+    literals[ix] =
+        bignum_from_decimal(lexer_token_text(parser->lexer, tok), tok->len);
+  }
+  char *result = precise_execute(parser->compiled, parser->compiled_len, NULL,
+                                 literals, error);
+  for (int ix = 0; ix < parser->literal_count; ix++) {
+    bignum_free(literals[ix]);
+  }
+  free(literals);
+  if (profile_flag)
+    profile_evaluated(parser->compiled, parser->compiled_len, start, *error);
+  return result;
+}
+
+double parser_evaluate_real(Parser *parser, int *error) {
+  if (parser->parse_error) {
+    *error = parser->parse_error;
+    return 0;
+  }
+  uint64_t start = profile_flag ? profile_clock() : 0;
+  double result =
+      real_execute(parser->compiled, parser->compiled_len, NULL, error);
+  if (profile_flag)
+    profile_evaluated(parser->compiled, parser->compiled_len, start, *error);
+  return result;
+}
+
+// The right operand comes from the stack or from a fused instruction
+static inline int apply(TokenType opcode, long int *a, long int b,
+                        bool checked) {
+  switch (opcode) {
+  case add:
+    if (checked)
+      return arith_add(*a, b, a);
+    *a = *a + b;
+    return VALID;
+  case sub:
+    if (checked)
+      return arith_sub(*a, b, a);
+    *a = *a - b;
+    return VALID;
+  case mul:
+    if (checked)
+      return arith_mul(*a, b, a);
+    *a = *a * b;
+    return VALID;
+  case divide:
+    if (checked)
+      return arith_div(*a, b, a);
+    *a = *a / b;
+    return VALID;
+  case mod:
+    if (checked)
+      return arith_mod(*a, b, a);
+    *a = *a % b;
+    return VALID;
+  default: // power
+    return arith_pow(*a, b, a);
+  }
+}
+
+// The stack engine for verified code: the stack is allocated once at its
+// final size and operands are never checked for. Inlined into one loop per
+// arithmetic mode, so neither tests the mode per instruction.
+static inline __attribute__((always_inline)) long int
+execute_loop(const Instruction *code, int len, int max_depth,
+             const long int *values, int *error, bool checked) {
+  long int local[LOCAL_STACK_DEPTH];
+  long int *stack = max_depth <= LOCAL_STACK_DEPTH
+                        ? local
+                        : malloc(max_depth * sizeof(long int));
+  if (!stack) {
+    *error = OUT_OF_MEMORY;
+    return 0;
+  }
+  long int *sp = stack;
+  long int temps[MAX_TEMPS];
+  int err = VALID;
+
+  for (int ix = 0; ix < len && !err; ix++) {
+    TokenType opcode = code[ix].opcode;
+    long int value = code[ix].value;
+    if (opcode == number) {
+      *sp++ = value;
+    } else if (opcode == variable) {
+      if (values)
+        *sp++ = values[value];
+      else
+        err = UNBOUND_VARIABLE;
+    } else if (opcode == absolute) {
+      if (checked)
+        err = arith_abs(sp[-1], &sp[-1]);
+      else
+        sp[-1] = labs(sp[-1]);
+    } else if (opcode == store_temp) {
+      temps[value] = sp[-1];
+    } else if (opcode == load_temp) {
+      *sp++ = temps[value];
+    } else if (opcode >= add_imm) {
+      err = apply(add + (opcode - add_imm), &sp[-1], value, checked);
+    } else {
+      --sp;
+      err = apply(opcode, &sp[-1], sp[0], checked);
+    }
+  }
+
+  // Verified code leaves exactly one value, an empty program leaves none
+  long int result = err || sp == stack ? 0 : sp[-1];
+  if (stack != local)
+    free(stack);
+  if (err)
+    *error = err;
+  return result;
+}
+
+static long int execute_plain(const Instruction *code, int len, int max_depth,
+                              const long int *values, int *error) {
+  return execute_loop(code, len, max_depth, values, error, false);
+}
+
+static long int execute_checked(const Instruction *code, int len,
+                                int max_depth, const long int *values,
+                                int *error) {
+  return execute_loop(code, len, max_depth, values, error, true);
+}
+
+long int parser_execute(const Instruction *code, int len,
+                        const long int *values, int *error) {
+  int max_depth;
+  int err = verify_program(code, len, &max_depth);
+  if (err) {
+    *error = err;
+    return 0;
+  }
+  return parser_execute_verified(code, len, max_depth, parser_checked_flag,
+                                 values, error);
+}
+
+long int parser_execute_verified(const Instruction *code, int len,
+                                 int max_depth, bool checked,
+                                 const long int *values, int *error) {
+  // Only the stack engine carries the debug hooks. Code run once is not
+  // worth mapping native code for, so the JIT engine runs it threaded and
+  // only a Program is compiled to native code.
+  if (parser_engine != ENGINE_STACK && !parser_debug_flag) {
+    return threaded_execute(code, len, max_depth, checked, values, error);
+  }
+  if (!parser_debug_flag) {
+    return checked
+               ? execute_checked(code, len, max_depth, values, error)
+               : execute_plain(code, len, max_depth, values, error);
+  }
+
   Stack *stack = stack_create();
+  if (!stack) {
+    *error = OUT_OF_MEMORY;
+    return 0;
+  }
   Instruction instruction;
+  long int temps[MAX_TEMPS];
   int err = 0;
 
-  for (int ix = 0; ix < parser->compiled_len; ix++) {
-    instruction = parser->compiled[ix];
-    TokenType opcode = parser->compiled[ix].opcode;
-    StackOperationFunc stack_func = stack_operation_table[opcode];
+  for (int ix = 0; ix < len; ix++) {
+    instruction = code[ix];
+    TokenType opcode = instruction.opcode;
+    // Shared subexpressions move between the stack and the temporaries
+    if (opcode == store_temp || opcode == load_temp) {
+      if (opcode == store_temp) {
+        temps[instruction.value] = stack_peek(stack, &err);
+      } else if (!stack_push(stack, temps[instruction.value])) {
+        stack_free(stack);
+        *error = OUT_OF_MEMORY;
+        return 0;
+      }
+      fprintf(stderr, "[EVALUATOR] Instruction: %s, temporary: %ld\n",
+              opcode == store_temp ? "STORE" : "LOAD", instruction.value);
+      fprintf(stderr, "Stack:\n");
+      stack_print(stack);
+      continue;
+    }
     // make sure that the value is within the range of array
     // Mainly as a precaution
-    if (opcode < add || opcode > number) {
+    if (opcode < add || opcode > power_imm) {
       stack_free(stack);
       *error = INVALID_EXPRESSION;
       return 0;
     }
-    if (!stack_func(stack, parser->compiled[ix].value, error)) {
+    long int value = instruction.value;
+    // Fused operators push their immediate and run the plain operator
+    if (opcode >= add_imm) {
+      if (!stack_push(stack, value)) {
+        stack_free(stack);
+        *error = OUT_OF_MEMORY;
+        return 0;
+      }
+      opcode = add + (opcode - add_imm);
+    }
+    StackOperationFunc stack_func = stack_operation_table[opcode];
+    if (opcode == variable) {
+      if (!values) {
+        stack_free(stack);
+        *error = UNBOUND_VARIABLE;
+        return 0;
+      }
+      value = values[value];
+    }
+    if (!stack_func(stack, value, checked, error)) {
       stack_free(stack);
       return 0;
     }
     if (parser_debug_flag) {
       fprintf(stderr, "[EVALUATOR] Instruction: %s, value: %ld\n",
-              tokens_by_name[instruction.opcode], instruction.value);
+              tokens_by_name[opcode], value);
       fprintf(stderr, "Stack:\n");
       stack_print(stack);
     }
@@ -224,8 +715,21 @@ void parser_output_postfix(Parser *parser) {
   printf("Postfix: ");
   for (int ix = 0; ix < parser->compiled_len; ix++) {
     Instruction instruction = parser->compiled[ix];
-    if (instruction.opcode == number) {
+    if (instruction.opcode == number && parser_float_flag) {
+      char text[FASTFLOAT_FORMAT_LEN];
+      fastfloat_format(real_from_bits(instruction.value), text);
+      printf("%s ", text);
+    } else if (instruction.opcode == number) {
       printf("%ld ", instruction.value);
+    } else if (instruction.opcode == variable) {
+      printf("%.*s ", (int)parser->variable_lens[instruction.value],
+             parser->variables[instruction.value]);
+    } else if (instruction.opcode == big_number) {
+      Token *tok = &parser->literals[instruction.value];
+      printf("%.*s ", (int)tok->len, lexer_token_text(parser->lexer, tok));
+    } else if (instruction.opcode >= add_imm) {
+      printf("%ld %s", instruction.value,
+             tokens_as_strings[add + (instruction.opcode - add_imm)]);
     } else {
       printf("%s", tokens_as_strings[instruction.opcode]);
     }
@@ -233,21 +737,26 @@ void parser_output_postfix(Parser *parser) {
   printf("\n");
 }
 
-bool parser_parse_postfix(Parser *parser) {
+static bool parse_postfix(Parser *parser) {
   Token *tok;
-  lexer_advance_token(parser->lexer);
+  advance(parser);
   tok = lexer_get_token(parser->lexer);
   while (tok->type != end) {
     TokenType opcode = tok->type;
     if (opcode == unknown) {
       return false;
     }
+    bool emitted;
     if (opcode == number)
-      emit(parser, opcode, atoll(tok->buf));
+      emitted = emit_number(parser, tok);
+    else if (opcode == variable)
+      emitted = emit_variable(parser, tok);
     else
-      emit(parser, opcode, IGNORE_VALUE);
+      emitted = emit(parser, opcode, IGNORE_VALUE);
+    if (!emitted)
+      return false;
 
-    lexer_advance_token(parser->lexer);
+    advance(parser);
     tok = lexer_get_token(parser->lexer);
   }
 
@@ -255,12 +764,94 @@ bool parser_parse_postfix(Parser *parser) {
   return true;
 }
 
+bool parser_parse_postfix(Parser *parser) {
+  return compile(parser, parse_postfix);
+}
+
+const char *parser_error_string(int error) {
+  switch (error) {
+  case INVALID_EXPRESSION:
+    return "Invalid Expression";
+  case MISSING_OPERAND:
+    return "Missing Operand(s)";
+  case MISSING_OPERATOR:
+    return "Missing Operator(s)";
+  case UNBOUND_VARIABLE:
+    return "Unbound Variable(s)";
+  case OUT_OF_MEMORY:
+    return "Expression Too Large";
+  case NUMBER_OVERFLOW:
+    return "Number Out Of Range";
+  case ARITHMETIC_OVERFLOW:
+    return "Arithmetic Overflow";
+  case DIVISION_BY_ZERO:
+    return "Division By Zero";
+  }
+  return "Unknown Error";
+}
+
+int parser_parse_error(Parser *parser) {
+  return parser->parse_error ? parser->parse_error : INVALID_EXPRESSION;
+}
+
+const Instruction *parser_instructions(Parser *parser, int *len) {
+  *len = parser->compiled_len;
+  return parser->compiled;
+}
+
+void parser_optimize(Parser *parser) {
+  OptimizerStats stats;
+  parser->compiled_len =
+      optimizer_run(parser->compiled, parser->compiled_len, &stats);
+  parser->operations = stats.operations;
+  parser->unique_operations = stats.unique_operations;
+  // Folding only ever lowers the depth, measure it again to size exactly
+  if (!parser->parse_error)
+    verify_program(parser->compiled, parser->compiled_len, &parser->max_depth);
+}
+
+void parser_subexpressions(Parser *parser, int *operations,
+                           int *unique_operations) {
+  *operations = parser->operations;
+  *unique_operations = parser->unique_operations;
+}
+
+int parser_variable_count(Parser *parser) { return parser->variable_count; }
+
+const char *parser_variable_name(Parser *parser, int slot, size_t *len) {
+  *len = parser->variable_lens[slot];
+  return parser->variables[slot];
+}
+
+bool parser_set_engine(const char *name) {
+  if (!strcmp(name, "stack")) {
+    parser_engine = ENGINE_STACK;
+  } else if (!strcmp(name, "threaded")) {
+    parser_engine = ENGINE_THREADED;
+  } else if (!strcmp(name, "jit")) {
+    parser_engine = ENGINE_JIT;
+  } else {
+    return false;
+  }
+  return true;
+}
+
 void parser_debug_mode() {
   lexer_debug_flag = 1;
   parser_debug_flag = 1;
 }
 
-bool stackop_add(Stack *stack, long int value, int *error) {
+void parser_checked_mode() { parser_checked_flag = 1; }
+
+void parser_precise_mode() { parser_precise_flag = 1; }
+
+void parser_float_mode() {
+  lexer_float_flag = 1;
+  parser_float_flag = 1;
+}
+
+bool stackop_add(Stack *stack, long int value, bool checked, int *error) {
+  (void)value;
   long int v1, v2;
   int err = 0;
   v1 = stack_pop(stack, &err);
@@ -272,11 +863,22 @@ bool stackop_add(Stack *stack, long int value, int *error) {
   if (parser_debug_flag) {
     fprintf(stderr, "[EVALUATOR] %ld + %ld\n", v2, v1);
   }
-  stack_push(stack, v2 + v1);
+  long int result;
+  if (checked) {
+    err = arith_add(v2, v1, &result);
+    if (err) {
+      *error = err;
+      return false;
+    }
+  } else {
+    result = v2 + v1;
+  }
+  stack_push(stack, result);
   return true;
 }
 
-bool stackop_sub(Stack *stack, long int value, int *error) {
+bool stackop_sub(Stack *stack, long int value, bool checked, int *error) {
+  (void)value;
   long int v1, v2;
   int err = 0;
   v1 = stack_pop(stack, &err);
@@ -288,11 +890,22 @@ bool stackop_sub(Stack *stack, long int value, int *error) {
   if (parser_debug_flag) {
     fprintf(stderr, "[EVALUATOR] %ld - %ld\n", v2, v1);
   }
-  stack_push(stack, v2 - v1);
+  long int result;
+  if (checked) {
+    err = arith_sub(v2, v1, &result);
+    if (err) {
+      *error = err;
+      return false;
+    }
+  } else {
+    result = v2 - v1;
+  }
+  stack_push(stack, result);
   return true;
 }
 
-bool stackop_mul(Stack *stack, long int value, int *error) {
+bool stackop_mul(Stack *stack, long int value, bool checked, int *error) {
+  (void)value;
   long int v1, v2;
   int err = 0;
   v1 = stack_pop(stack, &err);
@@ -304,11 +917,22 @@ bool stackop_mul(Stack *stack, long int value, int *error) {
   if (parser_debug_flag) {
     fprintf(stderr, "[EVALUATOR] %ld * %ld\n", v2, v1);
   }
-  stack_push(stack, v2 * v1);
+  long int result;
+  if (checked) {
+    err = arith_mul(v2, v1, &result);
+    if (err) {
+      *error = err;
+      return false;
+    }
+  } else {
+    result = v2 * v1;
+  }
+  stack_push(stack, result);
   return true;
 }
 
-bool stackop_div(Stack *stack, long int value, int *error) {
+bool stackop_div(Stack *stack, long int value, bool checked, int *error) {
+  (void)value;
   long int v1, v2;
   int err = 0;
   v1 = stack_pop(stack, &err);
@@ -320,11 +944,22 @@ bool stackop_div(Stack *stack, long int value, int *error) {
   if (parser_debug_flag) {
     fprintf(stderr, "[EVALUATOR] %ld / %ld\n", v2, v1);
   }
-  stack_push(stack, v2 / v1);
+  long int result;
+  if (checked) {
+    err = arith_div(v2, v1, &result);
+    if (err) {
+      *error = err;
+      return false;
+    }
+  } else {
+    result = v2 / v1;
+  }
+  stack_push(stack, result);
   return true;
 }
 
-bool stackop_mod(Stack *stack, long int value, int *error) {
+bool stackop_mod(Stack *stack, long int value, bool checked, int *error) {
+  (void)value;
   long int v1, v2;
   int err = 0;
   v1 = stack_pop(stack, &err);
@@ -336,11 +971,22 @@ bool stackop_mod(Stack *stack, long int value, int *error) {
   if (parser_debug_flag) {
     fprintf(stderr, "[EVALUATOR] %ld %% %ld\n", v2, v1);
   }
-  stack_push(stack, v2 % v1);
+  long int result;
+  if (checked) {
+    err = arith_mod(v2, v1, &result);
+    if (err) {
+      *error = err;
+      return false;
+    }
+  } else {
+    result = v2 % v1;
+  }
+  stack_push(stack, result);
   return true;
 }
 
-bool stackop_pow(Stack *stack, long int value, int *error) {
+bool stackop_pow(Stack *stack, long int value, bool checked, int *error) {
+  (void)value;
   long int v1, v2;
   int err = 0;
   v1 = stack_pop(stack, &err);
@@ -352,11 +998,20 @@ bool stackop_pow(Stack *stack, long int value, int *error) {
   if (parser_debug_flag) {
     fprintf(stderr, "[EVALUATOR] pow(%ld , %ld)\n", v2, v1);
   }
-  stack_push(stack, (long int)pow(v2, v1));
+  // Powers are always checked, see arith_pow
+  (void)checked;
+  long int result;
+  err = arith_pow(v2, v1, &result);
+  if (err) {
+    *error = err;
+    return false;
+  }
+  stack_push(stack, result);
   return true;
 }
 
-bool stackop_abs(Stack *stack, long int value, int *error) {
+bool stackop_abs(Stack *stack, long int value, bool checked, int *error) {
+  (void)value;
   long int v1;
   int err = 0;
   v1 = stack_pop(stack, &err);
@@ -368,14 +1023,29 @@ bool stackop_abs(Stack *stack, long int value, int *error) {
     fprintf(stderr, "[EVALUATOR] Absoule value of %ld \n", v1);
   }
 
-  stack_push(stack, labs(v1));
+  long int result;
+  if (checked) {
+    err = arith_abs(v1, &result);
+    if (err) {
+      *error = err;
+      return false;
+    }
+  } else {
+    result = labs(v1);
+  }
+  stack_push(stack, result);
   return true;
 }
 
-bool stackop_push_num(Stack *stack, long int value, int *error) {
+bool stackop_push_num(Stack *stack, long int value, bool checked,
+                      int *error) {
+  (void)checked;
   if (parser_debug_flag) {
     fprintf(stderr, "[EVALUATOR] Pushing %ld \n", value);
   }
-  stack_push(stack, value);
+  if (!stack_push(stack, value)) {
+    *error = OUT_OF_MEMORY;
+    return false;
+  }
   return true;
 }
@@ -4,12 +4,30 @@
 #include <stdbool.h>
 #include "lexer.h"
 
+#define MAX_VARIABLES 64
+// Temporaries a program may keep shared subexpressions in, at most 64 as
+// verify_program tracks them in a bitmask
+#define MAX_TEMPS 64
+
 enum parser_errors
 {
   VALID,
   INVALID_EXPRESSION,
   MISSING_OPERAND,
-  MISSING_OPERATOR
+  MISSING_OPERATOR,
+  UNBOUND_VARIABLE,
+  OUT_OF_MEMORY,
+  NUMBER_OVERFLOW,
+  ARITHMETIC_OVERFLOW,
+  DIVISION_BY_ZERO
+};
+
+// Interpreters that can run compiled instructions, see parser_set_engine
+enum parser_engines
+{
+  ENGINE_STACK,
+  ENGINE_THREADED,
+  ENGINE_JIT
 };
 
 /*
@@ -18,23 +36,44 @@ enum parser_errors
 expression ::= term ( ('+'|'-') term )*
 term ::= exp ( ('*' | '/' | '%) exp )*
 exp ::= factor ( '^' exp)?
-factor ::= '(' expression ')' | NUMBER | 'abs' factor
-NUMBER ::= '-'? DIGIT+
+factor ::= '(' expression ')' | NUMBER | VARIABLE | 'abs' factor
+NUMBER ::= '-'? DIGIT+ ( '.' DIGIT* )? ( ('e'|'E') ('+'|'-')? DIGIT+ )?
+    (the fraction and exponent only in float mode)
+VARIABLE ::= LETTER ( LETTER | DIGIT | '_' )*
 DIGIT ::= '0' | '1' | '2'….
 */
 
+// One bytecode operation, the opcodes are the operator TokenTypes.
+// number pushes value, variable pushes the binding in slot value and the
+// *_imm operators use value as their right operand. store_temp copies the
+// top of the stack into temporary value, which load_temp pushes again.
+typedef struct instruction
+{
+  TokenType opcode;
+  long int value;
+} Instruction;
+
 struct parser;
 typedef struct parser Parser;
 
+typedef bool (*ParseFunc)(Parser *parser);
+
 extern int parser_debug_flag;
+extern int parser_engine;
+extern int parser_checked_flag;
+extern int parser_precise_flag;
+extern int parser_float_flag;
 
 /**
  * @brief Creates a Parser object.
  *
- * @param buf The string to parse.
+ * The source is not copied and must outlive the parser.
+ *
+ * @param src The text to parse.
+ * @param len The length of src.
  * @return Parser* The new parser object.
  */
-Parser *parser_new(char *buf);
+Parser *parser_new(const char *src, size_t len);
 
 /**
  * @brief Releases the resources used by the given parser.
@@ -48,6 +87,17 @@ void parser_free(Parser *parser);
  */
 bool parser_parse_infix(Parser *parser);
 
+/**
+ * @brief An iterative parser for infix strings.
+ *
+ * Accepts the same grammar and emits the same instructions as
+ * parser_parse_infix, but keeps pending operators on the heap so deeply
+ * nested input cannot overflow the C stack.
+ *
+ * @return A bool indicating if it could be parsed.
+ */
+bool parser_parse_infix_iterative(Parser *parser);
+
 /**
  * @brief Evalutes each given instruction.
  *
@@ -55,9 +105,103 @@ bool parser_parse_infix(Parser *parser);
  */
 long int parser_evaluate(Parser *parser, int *errno);
 
+/**
+ * @brief Evaluates the instructions exactly, with arbitrary precision.
+ *
+ * Used in parser_precise_mode. Intermediate values that outgrow a long int
+ * are promoted to big integers instead of overflowing.
+ *
+ * @return char* The result in decimal freed by the caller, NULL on error.
+ */
+char *parser_evaluate_precise(Parser *parser, int *error);
+
+/**
+ * @brief Evaluates the instructions in double precision.
+ *
+ * Used in parser_float_mode, where number instructions hold doubles.
+ *
+ * @return double The result of all the operations.
+ */
+double parser_evaluate_real(Parser *parser, int *error);
+
+/**
+ * @brief Runs a compiled instruction stream on the selected engine.
+ *
+ * The code is checked with verify_program first, so a malformed program
+ * fails with its verification error before anything is evaluated. It runs
+ * in the current parser_checked_mode.
+ *
+ * @param code The instructions to execute.
+ * @param len The number of instructions.
+ * @param values The variable bindings indexed by slot, may be NULL if the
+ *               code uses no variables.
+ * @return long int The result of all the operations.
+ */
+long int parser_execute(const Instruction *code, int len,
+                        const long int *values, int *error);
+
+/**
+ * @brief Runs an instruction stream that verify_program accepted.
+ *
+ * The stack and threaded engines allocate max_depth values once and check
+ * nothing but the arithmetic, so the code must be exactly what was
+ * verified.
+ *
+ * @param max_depth The depth verify_program reported for the code.
+ * @param checked Whether to use checked arithmetic, parser_checked_flag
+ *                as it was when the code was compiled.
+ * @return long int The result, or 0 with OUT_OF_MEMORY if max_depth values
+ *                  could not be allocated.
+ */
+long int parser_execute_verified(const Instruction *code, int len,
+                                 int max_depth, bool checked,
+                                 const long int *values, int *error);
+
+/**
+ * @brief Gets the instructions compiled by the last parse.
+ *
+ * @param len Receives the number of instructions.
+ */
+const Instruction *parser_instructions(Parser *parser, int *len);
+
+/**
+ * @brief Runs the optimizer over the instructions compiled by the last parse.
+ */
+void parser_optimize(Parser *parser);
+
+/**
+ * @brief Gets the operation counts of the last parser_optimize.
+ *
+ * Numbers and variables are not counted, only the operators applied to
+ * them.
+ *
+ * @param operations Receives the number of operators in the folded code.
+ * @param unique_operations Receives how many of them are distinct. Common
+ *                          subexpression elimination evaluates each of
+ *                          those once, as long as temporaries remain.
+ */
+void parser_subexpressions(Parser *parser, int *operations,
+                           int *unique_operations);
+
+/**
+ * @brief Gets the number of distinct variables in the parsed expression.
+ */
+int parser_variable_count(Parser *parser);
+
+/**
+ * @brief Gets the name of the variable bound to the given slot.
+ *
+ * @param len Receives the length of the name, which is not NUL terminated.
+ */
+const char *parser_variable_name(Parser *parser, int slot, size_t *len);
+
 /**
  * @brief A parser used to parse a postfix string.
  *
+ * Tokens are taken in any order, so the emitted code is verified before
+ * the parse succeeds: operators short of operands and leftover values fail
+ * it with MISSING_OPERAND and MISSING_OPERATOR.
+ *
  * @return A bool indicating if it could be parsed.
  */
 bool parser_parse_postfix(Parser *parser);
@@ -67,9 +211,66 @@ bool parser_parse_postfix(Parser *parser);
  */
 void parser_output_postfix(Parser *parser);
 
+/**
+ * @brief Describes one of the parser_errors codes.
+ *
+ * @return A message suitable for printing after "ERROR: ".
+ */
+const char *parser_error_string(int error);
+
+/**
+ * @brief Gets the parser_errors code explaining why the last parse failed.
+ *
+ * @return int OUT_OF_MEMORY if the instructions outgrew what could be
+ *             allocated, NUMBER_OVERFLOW if a literal does not fit in a
+ *             long int, MISSING_OPERAND or MISSING_OPERATOR if the
+ *             postfix code does not verify, INVALID_EXPRESSION otherwise.
+ */
+int parser_parse_error(Parser *parser);
+
+/**
+ * @brief Selects the engine used to run instructions.
+ *
+ * @param name "stack" (the default, which prints debug output), "threaded"
+ *             or "jit" (native code for a Program, threaded for code that
+ *             is evaluated once or cannot be compiled).
+ * @return bool false if the name is not a known engine.
+ */
+bool parser_set_engine(const char *name);
+
 /**
  * @brief Enables debugging mode for detailed messages.
  */
 void parser_debug_mode();
 
+/**
+ * @brief Enables checked arithmetic.
+ *
+ * Overflow in + - * / abs reports ARITHMETIC_OVERFLOW and a zero divisor
+ * reports DIVISION_BY_ZERO instead of wrapping or trapping. Takes effect
+ * for code compiled after the call.
+ *
+ * Unchecked code divides with the machine instruction: a zero divisor, or
+ * LONG_MIN / -1, raises SIGFPE and kills the process.
+ */
+void parser_checked_mode();
+
+/**
+ * @brief Enables arbitrary-precision integers.
+ *
+ * Literals too large for a long int parse as big_number instructions, which
+ * only parser_evaluate_precise can run. Results are exact; only a result
+ * past BIGNUM_MAX_LIMBS reports ARITHMETIC_OVERFLOW.
+ */
+void parser_precise_mode();
+
+/**
+ * @brief Enables IEEE double arithmetic.
+ *
+ * Number literals may have a fraction and an exponent ("2.5e-3") and parse
+ * to doubles that only parser_evaluate_real can run. Takes precedence over
+ * parser_precise_mode.
+ */
+void parser_float_mode();
+
 #endif
\ No newline at end of file
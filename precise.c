@@ -0,0 +1,290 @@
+#include "precise.h"
+#include "arith.h"
+#include <stdio.h>
+#include <stdlib.h>
+
+// A stack entry, an unboxed small value unless big is set
+typedef struct value {
+  long int small;
+  BigNum *big;
+} Value;
+
+// Boxes the value in place, it keeps owning the result
+static BigNum *as_big(Value *value) {
+  if (!value->big)
+    value->big = bignum_from_long(value->small);
+  return value->big;
+}
+
+static void release(Value *value) {
+  bignum_free(value->big);
+  value->big = NULL;
+}
+
+// Stores a result, unboxing it again if it fits in a long int
+static int settle(Value *value, BigNum *num) {
+  if (!num)
+    return ARITHMETIC_OVERFLOW;
+  if (bignum_to_long(num, &value->small)) {
+    bignum_free(num);
+  } else {
+    value->big = num;
+  }
+  return VALID;
+}
+
+static bool is_zero(const Value *value) {
+  return !value->big && value->small == 0;
+}
+
+static bool is_negative(const Value *value) {
+  return value->big ? bignum_sign(value->big) < 0 : value->small < 0;
+}
+
+static bool is_odd(const Value *value) {
+  return value->big ? bignum_odd(value->big) : value->small & 1;
+}
+
+// Pushes the operand of a number, variable or big_number instruction
+static int load(Instruction instruction, const long int *values,
+                BigNum **literals, Value *out) {
+  out->big = NULL;
+  switch (instruction.opcode) {
+  case number:
+    out->small = instruction.value;
+    return VALID;
+  case variable:
+    if (!values)
+      return UNBOUND_VARIABLE;
+    out->small = values[instruction.value];
+    return VALID;
+  default: // big_number
+    out->big = literals[instruction.value];
+    literals[instruction.value] = NULL;
+    return out->big ? VALID : INVALID_EXPRESSION;
+  }
+}
+
+// Same results as arith_pow, past the range of a long int
+static int power_big(Value *base, Value *exponent) {
+  if (is_zero(exponent)) {
+    release(base);
+    base->small = 1;
+    return VALID;
+  }
+  bool small_base = !base->big && base->small >= -1 && base->small <= 1;
+  if (is_negative(exponent)) {
+    if (is_zero(base))
+      return DIVISION_BY_ZERO;
+    if (!small_base) {
+      release(base);
+      base->small = 0;
+    }
+  }
+  if (small_base) {
+    if (base->small == -1 && !is_odd(exponent))
+      base->small = 1;
+    return VALID;
+  }
+  if (is_negative(exponent))
+    return VALID;
+  // |base| >= 2 so a power this large cannot be represented
+  if (exponent->big)
+    return ARITHMETIC_OVERFLOW;
+
+  BigNum *result = bignum_pow(as_big(base), exponent->small);
+  release(base);
+  return settle(base, result);
+}
+
+// a = a op b, releasing both operands' boxes. Small operands go through the
+// checked kernels and are boxed only when those report an overflow.
+static int apply(TokenType opcode, Value *a, Value *b) {
+  bool small = !a->big && !b->big;
+  BigNum *result = NULL;
+  long int value;
+  int err = VALID;
+
+  switch (opcode) {
+  case add:
+    if (small && arith_add(a->small, b->small, &value) == VALID)
+      break;
+    result = bignum_add(as_big(a), as_big(b));
+    break;
+  case sub:
+    if (small && arith_sub(a->small, b->small, &value) == VALID)
+      break;
+    result = bignum_sub(as_big(a), as_big(b));
+    break;
+  case mul:
+    if (small && arith_mul(a->small, b->small, &value) == VALID)
+      break;
+    result = bignum_mul(as_big(a), as_big(b));
+    break;
+  case divide:
+  case mod:
+    if (is_zero(b)) {
+      err = DIVISION_BY_ZERO;
+      break;
+    }
+    // Only LONG_MIN / -1 overflows, and then a is small
+    if (small && opcode == mod) {
+      arith_mod(a->small, b->small, &value);
+      break;
+    }
+    if (small && arith_div(a->small, b->small, &value) == VALID)
+      break;
+    if (opcode == divide)
+      bignum_divmod(as_big(a), as_big(b), &result, NULL);
+    else
+      bignum_divmod(as_big(a), as_big(b), NULL, &result);
+    break;
+  default: // power
+    if (small) {
+      err = arith_pow(a->small, b->small, &value);
+      if (err != ARITHMETIC_OVERFLOW) {
+        if (!err)
+          a->small = value;
+        return err;
+      }
+    }
+    err = power_big(a, b);
+    release(b);
+    return err;
+  }
+
+  bool boxed = a->big || b->big;
+  release(a);
+  release(b);
+  if (err)
+    return err;
+  if (!boxed) {
+    a->small = value;
+    return VALID;
+  }
+  return settle(a, result);
+}
+
+// Finds a '%' applied straight to the result of the '^' at ix and loads its
+// right operand, returns how many instructions that consumed (0 if none)
+static int fused_modulus(const Instruction *code, int len, int ix,
+                         const long int *values, BigNum **literals,
+                         Value *modulus, int *error) {
+  if (ix + 1 < len && code[ix + 1].opcode == mod_imm) {
+    modulus->small = code[ix + 1].value;
+    modulus->big = NULL;
+    return 1;
+  }
+  if (ix + 2 < len && code[ix + 2].opcode == mod &&
+      (code[ix + 1].opcode == number || code[ix + 1].opcode == variable ||
+       code[ix + 1].opcode == big_number)) {
+    *error = load(code[ix + 1], values, literals, modulus);
+    return 2;
+  }
+  return 0;
+}
+
+// base = base ^ exponent % modulus with one modular exponentiation, unless
+// the power fits in a long int anyway
+static int power_mod(Value *base, Value *exponent, Value *modulus) {
+  if (!base->big && !exponent->big) {
+    long int power;
+    if (arith_pow(base->small, exponent->small, &power) == VALID) {
+      base->small = power;
+      return apply(mod, base, modulus);
+    }
+  }
+  BigNum *result =
+      bignum_powmod(as_big(base), as_big(exponent), as_big(modulus));
+  release(base);
+  release(exponent);
+  release(modulus);
+  return settle(base, result);
+}
+
+char *precise_execute(const Instruction *code, int len, const long int *values,
+                      BigNum **literals, int *error) {
+  // Every instruction pushes at most one value
+  Value *stack = malloc((len + 1) * sizeof(Value));
+  int depth = 0;
+  int err = VALID;
+
+  for (int ix = 0; ix < len && !err; ix++) {
+    TokenType opcode = code[ix].opcode;
+    if (opcode == number || opcode == variable || opcode == big_number) {
+      err = load(code[ix], values, literals, &stack[depth]);
+      if (!err)
+        ++depth;
+      continue;
+    }
+    if (opcode < add || opcode > power_imm) {
+      err = INVALID_EXPRESSION;
+      break;
+    }
+
+    Value operand = {code[ix].value, NULL};
+    if (opcode >= add_imm) {
+      opcode = add + (opcode - add_imm);
+    } else if (opcode != absolute) {
+      if (depth < 1) {
+        err = MISSING_OPERAND;
+        break;
+      }
+      operand = stack[--depth];
+    }
+    if (depth < 1) {
+      release(&operand);
+      err = MISSING_OPERAND;
+      break;
+    }
+    Value *top = &stack[depth - 1];
+
+    if (opcode == absolute) {
+      long int value;
+      if (top->big || arith_abs(top->small, &value) != VALID) {
+        BigNum *result = bignum_abs(as_big(top));
+        release(top);
+        err = settle(top, result);
+      } else {
+        top->small = value;
+      }
+    } else if (opcode == power) {
+      Value modulus;
+      int skip = fused_modulus(code, len, ix, values, literals, &modulus, &err);
+      if (err) {
+        release(&operand);
+        break;
+      }
+      if (skip && !is_negative(&operand) && !is_zero(&modulus)) {
+        err = power_mod(top, &operand, &modulus);
+      } else {
+        err = apply(power, top, &operand);
+        if (skip && !err)
+          err = apply(mod, top, &modulus);
+        else if (skip)
+          release(&modulus);
+      }
+      ix += skip;
+    } else {
+      err = apply(opcode, top, &operand);
+    }
+  }
+
+  char *text = NULL;
+  if (!err && depth != 1)
+    err = MISSING_OPERATOR;
+  if (!err) {
+    if (stack[0].big) {
+      text = bignum_to_decimal(stack[0].big);
+    } else {
+      text = malloc(24);
+      snprintf(text, 24, "%ld", stack[0].small);
+    }
+  }
+  for (int ix = 0; ix < depth; ix++) {
+    release(&stack[ix]);
+  }
+  free(stack);
+  *error = err;
+  return text;
+}
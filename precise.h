@@ -0,0 +1,31 @@
+#ifndef PRECISE_H
+#define PRECISE_H
+
+#include "bignum.h"
+#include "parser.h"
+
+/*
+  Exact evaluation for parser_precise_mode. Values stay unboxed long ints
+  while they fit and are promoted to BigNum only when an operation would
+  overflow, then demoted again as soon as a result fits. '^' directly
+  followed by '%' is computed as one modular exponentiation, so
+  "3^100000 % 1000" never builds the full power.
+*/
+
+/**
+ * @brief Evaluates instructions with arbitrary-precision integers.
+ *
+ * @param code The instructions to execute, which may contain big_number.
+ * @param len The number of instructions.
+ * @param values The variable bindings indexed by slot, may be NULL if the
+ *               code uses no variables.
+ * @param literals The big_number operands indexed by their value. Each one
+ *                 is moved onto the stack when its instruction runs and its
+ *                 slot set to NULL, the caller frees whatever is left.
+ * @param error Receives a parser_errors code on failure.
+ * @return char* The decimal result freed by the caller, NULL on error.
+ */
+char *precise_execute(const Instruction *code, int len, const long int *values,
+                      BigNum **literals, int *error);
+
+#endif
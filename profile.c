@@ -0,0 +1,156 @@
+#include "profile.h"
+#include <inttypes.h>
+#include <pthread.h>
+#include <stdlib.h>
+
+int profile_flag = 0;
+
+typedef struct phase_counters {
+  uint64_t count;
+  uint64_t total;
+  uint64_t min;
+  uint64_t max;
+  uint64_t buckets[PROFILE_BUCKETS];
+} PhaseCounters;
+
+typedef struct profile_counters {
+  PhaseCounters phases[PHASE_COUNT];
+  uint64_t opcodes[big_number + 1];
+  struct profile_counters *next;
+} ProfileCounters;
+
+static const char *phase_names[] = {"lex", "parse", "evaluate"};
+// Indexed by the TokenType of the opcode
+static const char *opcode_names[] = {
+    "add",        "sub",       "mul",        "divide",  "mod",
+    "power",      "absolute",  "number",     "variable", "add_imm",
+    "sub_imm",    "mul_imm",   "divide_imm", "mod_imm", "power_imm",
+    "store_temp", "load_temp", "big_number"};
+
+// Counters of the calling thread, allocated on its first record and kept
+// past its exit so the report still sees them
+static __thread ProfileCounters *local_counters = NULL;
+static ProfileCounters *all_counters = NULL;
+static pthread_mutex_t all_lock = PTHREAD_MUTEX_INITIALIZER;
+
+static ProfileCounters *counters() {
+  if (local_counters)
+    return local_counters;
+  ProfileCounters *new_counters = calloc(1, sizeof(ProfileCounters));
+  if (!new_counters)
+    return NULL;
+  pthread_mutex_lock(&all_lock);
+  new_counters->next = all_counters;
+  all_counters = new_counters;
+  pthread_mutex_unlock(&all_lock);
+  local_counters = new_counters;
+  return new_counters;
+}
+
+static int bucket(uint64_t ticks) {
+  return ticks ? 64 - __builtin_clzll(ticks) : 0;
+}
+
+static void add_sample(PhaseCounters *phase, uint64_t ticks) {
+  if (!phase->count || ticks < phase->min)
+    phase->min = ticks;
+  if (ticks > phase->max)
+    phase->max = ticks;
+  ++(phase->count);
+  phase->total += ticks;
+  ++(phase->buckets[bucket(ticks)]);
+}
+
+void profile_record(int phase, uint64_t ticks) {
+  ProfileCounters *local = counters();
+  if (local)
+    add_sample(&local->phases[phase], ticks);
+}
+
+void profile_evaluated(const Instruction *code, int len, uint64_t start,
+                       int error) {
+  uint64_t ticks = profile_clock() - start;
+  ProfileCounters *local = counters();
+  if (!local)
+    return;
+  add_sample(&local->phases[PHASE_EVALUATE], ticks);
+  if (error)
+    return;
+  for (int ix = 0; ix < len; ix++) {
+    if (code[ix].opcode <= big_number)
+      ++(local->opcodes[code[ix].opcode]);
+  }
+}
+
+static void merge_phase(PhaseCounters *into, const PhaseCounters *from) {
+  if (!from->count)
+    return;
+  if (!into->count || from->min < into->min)
+    into->min = from->min;
+  if (from->max > into->max)
+    into->max = from->max;
+  into->count += from->count;
+  into->total += from->total;
+  for (int ix = 0; ix < PROFILE_BUCKETS; ix++) {
+    into->buckets[ix] += from->buckets[ix];
+  }
+}
+
+static void report_phase(FILE *out, const char *name,
+                         const PhaseCounters *phase) {
+  fprintf(out,
+          "    \"%s\": {\"count\": %" PRIu64 ", \"total\": %" PRIu64
+          ", \"min\": %" PRIu64 ", \"max\": %" PRIu64 ", \"mean\": %.1f,\n"
+          "      \"histogram\": [",
+          name, phase->count, phase->total, phase->min, phase->max,
+          phase->count ? (double)phase->total / phase->count : 0.0);
+  // Only the buckets in use, each as its inclusive upper bound and count
+  bool first = true;
+  for (int ix = 0; ix < PROFILE_BUCKETS; ix++) {
+    if (!phase->buckets[ix])
+      continue;
+    uint64_t upper = ix == 64 ? UINT64_MAX : (1ULL << ix) - 1;
+    fprintf(out, "%s{\"le\": %" PRIu64 ", \"count\": %" PRIu64 "}",
+            first ? "" : ", ", upper, phase->buckets[ix]);
+    first = false;
+  }
+  fprintf(out, "]}");
+}
+
+void profile_report(FILE *out) {
+  ProfileCounters total = {0};
+  pthread_mutex_lock(&all_lock);
+  int threads = 0;
+  for (ProfileCounters *counters = all_counters; counters;
+       counters = counters->next) {
+    for (int phase = 0; phase < PHASE_COUNT; phase++) {
+      merge_phase(&total.phases[phase], &counters->phases[phase]);
+    }
+    for (int op = 0; op <= big_number; op++) {
+      total.opcodes[op] += counters->opcodes[op];
+    }
+    ++threads;
+  }
+  pthread_mutex_unlock(&all_lock);
+
+#if defined(__x86_64__)
+  const char *clock = "tsc";
+#else
+  const char *clock = "ns";
+#endif
+  fprintf(out, "{\n  \"clock\": \"%s\",\n  \"threads\": %d,\n", clock,
+          threads);
+  fprintf(out, "  \"phases\": {\n");
+  for (int phase = 0; phase < PHASE_COUNT; phase++) {
+    report_phase(out, phase_names[phase], &total.phases[phase]);
+    fprintf(out, phase + 1 < PHASE_COUNT ? ",\n" : "\n");
+  }
+  fprintf(out, "  },\n  \"opcodes\": {");
+  for (int op = 0; op <= big_number; op++) {
+    fprintf(out, "%s\"%s\": %" PRIu64, op ? ", " : "", opcode_names[op],
+            total.opcodes[op]);
+  }
+  fprintf(out, "}\n}\n");
+}
+
+void profile_mode() { profile_flag = 1; }
@@ -0,0 +1,78 @@
+#ifndef PROFILE_H
+#define PROFILE_H
+
+#include <stdint.h>
+#include <stdio.h>
+#include "parser.h"
+
+#if defined(__x86_64__)
+#include <x86intrin.h>
+#else
+#include <time.h>
+#endif
+
+/*
+  Per-phase timing and opcode counts. While profile_flag is set, the time
+  of every lex, parse and evaluation is added to a log2 histogram of its
+  phase, and every evaluated instruction to the count of its opcode. Each
+  thread records into its own counters, which are only summed by the
+  report, so batch workers never contend. Disabled, each hook is one test
+  of the flag.
+*/
+
+// Histogram buckets, bucket b holds durations in [2^(b-1), 2^b)
+#define PROFILE_BUCKETS 65
+
+enum profile_phases
+{
+  PHASE_LEX,      // lexer_advance_token calls of one parse
+  PHASE_PARSE,    // One parse, without its lexing
+  PHASE_EVALUATE, // One evaluation
+  PHASE_COUNT
+};
+
+extern int profile_flag;
+
+/**
+ * @brief Reads the profiling clock.
+ *
+ * @return uint64_t The time stamp counter on x86-64, nanoseconds elsewhere.
+ */
+static inline uint64_t profile_clock() {
+#if defined(__x86_64__)
+  return __rdtsc();
+#else
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (uint64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+#endif
+}
+
+/**
+ * @brief Adds one duration to a phase histogram of the calling thread.
+ *
+ * @param phase One of the profile_phases.
+ * @param ticks The duration in profile_clock units.
+ */
+void profile_record(int phase, uint64_t ticks);
+
+/**
+ * @brief Records an evaluation that started at the given profile_clock.
+ *
+ * The instructions are only counted if the evaluation succeeded, since a
+ * failed one stops partway through.
+ */
+void profile_evaluated(const Instruction *code, int len, uint64_t start,
+                       int error);
+
+/**
+ * @brief Writes the counters of all threads as a JSON object.
+ */
+void profile_report(FILE *out);
+
+/**
+ * @brief Enables profiling.
+ */
+void profile_mode();
+
+#endif
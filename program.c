@@ -0,0 +1,128 @@
+#include "program.h"
+#include "jit.h"
+#include "optimizer.h"
+#include "real.h"
+#include "threaded.h"
+#include "verify.h"
+#include <stdlib.h>
+#include <string.h>
+
+struct program {
+  Instruction *code;
+  int len;
+  int max_depth;
+  bool checked; // parser_checked_flag when it was compiled
+  bool real;    // Compiled in parser_float_mode, numbers hold double bits
+  char **variables;
+  int variable_count;
+  ThreadedCode *threaded;
+  JitCode *jit;
+};
+
+Program *program_compile(char *src, ParseFunc parse_func, int *error) {
+  Parser *parser = parser_new(src, strlen(src));
+  if (!parse_func(parser)) {
+    *error = parser_parse_error(parser);
+    parser_free(parser);
+    return NULL;
+  }
+  // Big literals need the bignum engine, which Programs do not run
+  int len;
+  const Instruction *code = parser_instructions(parser, &len);
+  for (int ix = 0; ix < len; ix++) {
+    if (code[ix].opcode == big_number) {
+      *error = NUMBER_OVERFLOW;
+      parser_free(parser);
+      return NULL;
+    }
+  }
+
+  Program *program = malloc(sizeof(Program));
+  program->len = len;
+  program->code = malloc(program->len * sizeof(Instruction));
+  memcpy(program->code, code, program->len * sizeof(Instruction));
+  program->checked = parser_checked_flag;
+  program->real = parser_float_flag;
+  program->threaded = NULL;
+  program->jit = NULL;
+  // Double code runs on real_execute alone, the optimizer and the integer
+  // engines would treat its numbers as long ints
+  if (!program->real) {
+    program->len = optimizer_run(program->code, program->len, NULL);
+    // The parse verified the code, this only measures the optimized depth
+    verify_program(program->code, program->len, &program->max_depth);
+    program->threaded = threaded_compile(program->code, program->len,
+                                         program->max_depth, program->checked);
+    if (parser_engine == ENGINE_JIT)
+      program->jit =
+          jit_compile(program->code, program->len, program->checked);
+  }
+
+  program->variable_count = parser_variable_count(parser);
+  program->variables = malloc(program->variable_count * sizeof(char *));
+  for (int ix = 0; ix < program->variable_count; ix++) {
+    size_t len;
+    const char *name = parser_variable_name(parser, ix, &len);
+    program->variables[ix] = strndup(name, len);
+  }
+
+  parser_free(parser);
+  return program;
+}
+
+void program_free(Program *program) {
+  if (!program)
+    return;
+
+  for (int ix = 0; ix < program->variable_count; ix++) {
+    free(program->variables[ix]);
+  }
+  jit_free(program->jit);
+  threaded_free(program->threaded);
+  free(program->code);
+  free(program->variables);
+  free(program);
+}
+
+int program_variable_count(const Program *program) {
+  return program->variable_count;
+}
+
+const char *program_variable_name(const Program *program, int slot) {
+  return program->variables[slot];
+}
+
+int program_variable_index(const Program *program, const char *name) {
+  for (int ix = 0; ix < program->variable_count; ix++) {
+    if (!strcmp(program->variables[ix], name))
+      return ix;
+  }
+  return -1;
+}
+
+long int program_evaluate(const Program *program, const long int *values,
+                          int *error) {
+  if (program->variable_count > 0 && !values) {
+    *error = UNBOUND_VARIABLE;
+    return 0;
+  }
+  if (program->real)
+    return real_to_bits(
+        real_execute(program->code, program->len, values, error));
+  if (parser_engine == ENGINE_JIT && program->jit && !parser_debug_flag) {
+    return jit_run(program->jit, values, error);
+  }
+  if (parser_engine != ENGINE_STACK && program->threaded &&
+      !parser_debug_flag) {
+    return threaded_run(program->threaded, values, error);
+  }
+  return parser_execute_verified(program->code, program->len,
+                                 program->max_depth, program->checked, values,
+                                 error);
+}
+
+double program_evaluate_real(const Program *program, const long int *values,
+                             int *error) {
+  long int result = program_evaluate(program, values, error);
+  return program->real ? real_from_bits(result) : (double)result;
+}
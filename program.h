@@ -0,0 +1,78 @@
+#ifndef PROGRAM_H
+#define PROGRAM_H
+
+#include "parser.h"
+
+/*
+  A Program is an expression compiled once into immutable bytecode. It can be
+  evaluated any number of times, from any number of threads, against
+  different variable bindings without lexing or parsing again.
+
+    Program *program = program_compile("(price * qty) % 7",
+                                       parser_parse_infix, &err);
+    long int values[2];
+    values[program_variable_index(program, "price")] = 120;
+    values[program_variable_index(program, "qty")] = 3;
+    long int result = program_evaluate(program, values, &err);
+*/
+
+struct program;
+typedef struct program Program;
+
+/**
+ * @brief Compiles an expression into a Program.
+ *
+ * @param src The expression to compile.
+ * @param parse_func The parser to use (infix or postfix).
+ * Programs run on long ints or, in parser_float_mode, doubles. A literal
+ * that only parser_precise_mode can hold reports NUMBER_OVERFLOW.
+ *
+ * @param error Receives a parser_errors code if compilation fails.
+ * @return Program* The new program, or NULL if src could not be parsed.
+ */
+Program *program_compile(char *src, ParseFunc parse_func, int *error);
+
+/**
+ * @brief Releases the resources used by the given program.
+ */
+void program_free(Program *program);
+
+/**
+ * @brief Gets the number of variables the program must be given values for.
+ */
+int program_variable_count(const Program *program);
+
+/**
+ * @brief Gets the name of the variable in the given slot.
+ */
+const char *program_variable_name(const Program *program, int slot);
+
+/**
+ * @brief Finds the slot of a variable by name.
+ *
+ * @return int The slot, or -1 if the program does not use the variable.
+ */
+int program_variable_index(const Program *program, const char *name);
+
+/**
+ * @brief Evaluates the program.
+ *
+ * A Program compiled in parser_float_mode evaluates in double precision
+ * and returns the bits of its double, see program_evaluate_real.
+ *
+ * @param values One value per variable slot, may be NULL if there are none.
+ * @return long int The result of all the operations.
+ */
+long int program_evaluate(const Program *program, const long int *values,
+                          int *error);
+
+/**
+ * @brief Evaluates the program and returns the result as a double.
+ *
+ * The double result of a Program compiled in parser_float_mode, the long
+ * int result converted otherwise.
+ */
+double program_evaluate_real(const Program *program, const long int *values,
+                             int *error);
+
+#endif
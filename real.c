@@ -0,0 +1,85 @@
+#include "real.h"
+#include <math.h>
+#include <stdlib.h>
+
+// a op b, or a parser_errors code in checked mode
+static int apply(TokenType opcode, double *a, double b) {
+  double result;
+  switch (opcode) {
+  case add:
+    result = *a + b;
+    break;
+  case sub:
+    result = *a - b;
+    break;
+  case mul:
+    result = *a * b;
+    break;
+  case divide:
+    if (parser_checked_flag && b == 0)
+      return DIVISION_BY_ZERO;
+    result = *a / b;
+    break;
+  case mod:
+    if (parser_checked_flag && b == 0)
+      return DIVISION_BY_ZERO;
+    result = fmod(*a, b);
+    break;
+  default: // power
+    if (parser_checked_flag && *a == 0 && b < 0)
+      return DIVISION_BY_ZERO;
+    result = pow(*a, b);
+    break;
+  }
+  // Only finite operands can overflow, inf + 1 is just inf
+  if (parser_checked_flag && isinf(result) && isfinite(*a) && isfinite(b))
+    return ARITHMETIC_OVERFLOW;
+  *a = result;
+  return VALID;
+}
+
+double real_execute(const Instruction *code, int len, const long int *values,
+                    int *error) {
+  // Every instruction pushes at most one value
+  double *stack = malloc((len + 1) * sizeof(double));
+  int depth = 0;
+  int err = VALID;
+
+  for (int ix = 0; ix < len && !err; ix++) {
+    TokenType opcode = code[ix].opcode;
+    long int value = code[ix].value;
+    if (opcode == number) {
+      stack[depth++] = real_from_bits(value);
+    } else if (opcode == variable) {
+      if (values)
+        stack[depth++] = values[value];
+      else
+        err = UNBOUND_VARIABLE;
+    } else if (opcode < add || opcode > power_imm) {
+      err = INVALID_EXPRESSION;
+    } else if (opcode == absolute) {
+      if (depth < 1)
+        err = MISSING_OPERAND;
+      else
+        stack[depth - 1] = fabs(stack[depth - 1]);
+    } else if (opcode >= add_imm) {
+      if (depth < 1)
+        err = MISSING_OPERAND;
+      else
+        err = apply(add + (opcode - add_imm), &stack[depth - 1],
+                    real_from_bits(value));
+    } else if (depth < 2) {
+      err = MISSING_OPERAND;
+    } else {
+      --depth;
+      err = apply(opcode, &stack[depth - 1], stack[depth]);
+    }
+  }
+
+  if (!err && depth != 1)
+    err = MISSING_OPERATOR;
+  double result = err ? 0 : stack[0];
+  free(stack);
+  *error = err;
+  return result;
+}
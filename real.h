@@ -0,0 +1,39 @@
+#ifndef REAL_H
+#define REAL_H
+
+#include <string.h>
+#include "parser.h"
+
+/*
+  IEEE double evaluation for parser_float_mode. Number instructions carry
+  the bits of their double in the long int value, so the instruction
+  stream, the batch cache and its keys need no separate float variant.
+*/
+
+static inline long int real_to_bits(double value) {
+  long int bits;
+  memcpy(&bits, &value, sizeof(bits));
+  return bits;
+}
+
+static inline double real_from_bits(long int bits) {
+  double value;
+  memcpy(&value, &bits, sizeof(value));
+  return value;
+}
+
+/**
+ * @brief Evaluates instructions in double precision.
+ *
+ * '%' is fmod and '^' is pow. Division by zero and overflow give the IEEE
+ * infinities and NaN, unless parser_checked_mode turns them into
+ * DIVISION_BY_ZERO and ARITHMETIC_OVERFLOW.
+ *
+ * @param values The variable bindings indexed by slot, may be NULL if the
+ *               code uses no variables.
+ * @param error Receives a parser_errors code on failure.
+ */
+double real_execute(const Instruction *code, int len, const long int *values,
+                    int *error);
+
+#endif
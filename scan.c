@@ -0,0 +1,127 @@
+#include "scan.h"
+#include <stdbool.h>
+#include <stddef.h>
+
+#define S CLASS_SPACE
+#define P CLASS_PUNCT
+#define DN (CLASS_DIGIT | CLASS_NAME)
+#define AN (CLASS_ALPHA | CLASS_NAME)
+#define PN (CLASS_PUNCT | CLASS_NAME)
+
+// Bytes from 0x80 up belong to no class
+const unsigned char scan_class[256] = {
+     0,  0,  0,  0,  0,  0,  0,  0,  0,  S,  S,  S,  S,  S,  0,  0,
+     0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,
+     S,  P,  P,  P,  P,  P,  P,  P,  P,  P,  P,  P,  P,  P,  P,  P,
+    DN, DN, DN, DN, DN, DN, DN, DN, DN, DN,  P,  P,  P,  P,  P,  P,
+     P, AN, AN, AN, AN, AN, AN, AN, AN, AN, AN, AN, AN, AN, AN, AN,
+    AN, AN, AN, AN, AN, AN, AN, AN, AN, AN, AN,  P,  P,  P,  P, PN,
+     P, AN, AN, AN, AN, AN, AN, AN, AN, AN, AN, AN, AN, AN, AN, AN,
+    AN, AN, AN, AN, AN, AN, AN, AN, AN, AN, AN,  P,  P,  P,  P,  0,
+};
+
+#undef S
+#undef P
+#undef DN
+#undef AN
+#undef PN
+
+static const char *scan_scalar(const char *cp, const char *end, int mask)
+{
+  while (cp < end && (scan_class[(unsigned char)*cp] & mask))
+    ++cp;
+  return cp;
+}
+
+#if defined(__x86_64__)
+#include <immintrin.h>
+
+// Whitespace is ' ' or '\t'..'\r', digits are '0'..'9'; a byte lies in
+// [low, low + span] when min(byte - low, span) == byte - low
+static __m128i spaces_16(__m128i bytes)
+{
+  __m128i offset = _mm_sub_epi8(bytes, _mm_set1_epi8('\t'));
+  __m128i ranged = _mm_cmpeq_epi8(_mm_min_epu8(offset, _mm_set1_epi8(4)), offset);
+  return _mm_or_si128(ranged, _mm_cmpeq_epi8(bytes, _mm_set1_epi8(' ')));
+}
+
+static __m128i digits_16(__m128i bytes)
+{
+  __m128i offset = _mm_sub_epi8(bytes, _mm_set1_epi8('0'));
+  return _mm_cmpeq_epi8(_mm_min_epu8(offset, _mm_set1_epi8(9)), offset);
+}
+
+static const char *scan_sse2(const char *cp, const char *end, bool digits)
+{
+  while (end - cp >= 16)
+  {
+    __m128i bytes = _mm_loadu_si128((const __m128i *)cp);
+    unsigned run = _mm_movemask_epi8(digits ? digits_16(bytes) : spaces_16(bytes));
+    if (run != 0xFFFF)
+      return cp + __builtin_ctz(~run);
+    cp += 16;
+  }
+  return scan_scalar(cp, end, digits ? CLASS_DIGIT : CLASS_SPACE);
+}
+
+__attribute__((target("avx2")))
+static const char *scan_avx2(const char *cp, const char *end, bool digits)
+{
+  while (end - cp >= 32)
+  {
+    __m256i bytes = _mm256_loadu_si256((const __m256i *)cp);
+    __m256i low = _mm256_set1_epi8(digits ? '0' : '\t');
+    __m256i span = _mm256_set1_epi8(digits ? 9 : 4);
+    __m256i offset = _mm256_sub_epi8(bytes, low);
+    __m256i match = _mm256_cmpeq_epi8(_mm256_min_epu8(offset, span), offset);
+    if (!digits)
+      match = _mm256_or_si256(match, _mm256_cmpeq_epi8(bytes, _mm256_set1_epi8(' ')));
+    unsigned run = _mm256_movemask_epi8(match);
+    if (run != 0xFFFFFFFF)
+      return cp + __builtin_ctz(~run);
+    cp += 32;
+  }
+  return scan_sse2(cp, end, digits);
+}
+
+typedef const char *(*ScanFunc)(const char *cp, const char *end, bool digits);
+
+// SSE2 is part of x86-64, AVX2 is used when the CPU has it
+static ScanFunc scan_runs = scan_sse2;
+
+__attribute__((constructor)) static void scan_select()
+{
+  if (__builtin_cpu_supports("avx2"))
+    scan_runs = scan_avx2;
+}
+
+#else
+
+static const char *scan_runs(const char *cp, const char *end, bool digits)
+{
+  return scan_scalar(cp, end, digits ? CLASS_DIGIT : CLASS_SPACE);
+}
+
+#endif
+
+const char *scan_spaces(const char *cp, const char *end)
+{
+  // Most gaps are a single space, settle those without the vector setup
+  if (cp == end || !(scan_class[(unsigned char)*cp] & CLASS_SPACE))
+    return cp;
+  ++cp;
+  if (cp == end || !(scan_class[(unsigned char)*cp] & CLASS_SPACE))
+    return cp;
+  return scan_runs(cp, end, false);
+}
+
+const char *scan_digits(const char *cp, const char *end)
+{
+  // Most literals are a digit or two, the same shortcut as scan_spaces
+  if (cp == end || !(scan_class[(unsigned char)*cp] & CLASS_DIGIT))
+    return cp;
+  ++cp;
+  if (cp == end || !(scan_class[(unsigned char)*cp] & CLASS_DIGIT))
+    return cp;
+  return scan_runs(cp, end, true);
+}
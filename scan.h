@@ -0,0 +1,42 @@
+#ifndef SCAN_H
+#define SCAN_H
+
+/*
+  Character classification and run scanning for the lexer. Classes come from
+  a 256-entry table instead of the locale-aware ctype calls, and whitespace
+  and digit runs are skipped 16 or 32 bytes at a time with SSE2 or AVX2,
+  picked at startup from what the CPU supports. Scanning never reads past
+  the end of the span it is given.
+*/
+
+enum char_classes
+{
+  CLASS_SPACE = 1, // ' ', '\t', '\n', '\v', '\f', '\r'
+  CLASS_DIGIT = 2,
+  CLASS_ALPHA = 4,
+  CLASS_PUNCT = 8, // Printable ASCII other than letters, digits and ' '
+  CLASS_NAME = 16  // Letters, digits and '_', the rest of a name
+};
+
+// The char_classes bits of every byte, matching ctype in the C locale
+extern const unsigned char scan_class[256];
+
+/**
+ * @brief Skips a run of whitespace.
+ *
+ * @param cp The first character to look at.
+ * @param end One past the last readable character.
+ * @return const char* The first non-space character, or end.
+ */
+const char *scan_spaces(const char *cp, const char *end);
+
+/**
+ * @brief Skips a run of decimal digits.
+ *
+ * @param cp The first character to look at.
+ * @param end One past the last readable character.
+ * @return const char* The first non-digit character, or end.
+ */
+const char *scan_digits(const char *cp, const char *end);
+
+#endif
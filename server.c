@@ -0,0 +1,411 @@
+#include "server.h"
+#include "util.h"
+#include <errno.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/epoll.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+// Bytes read from a connection per wakeup
+#define SERVER_READ_SIZE 65536
+#define SERVER_EVENTS 256
+// Bytes of the big-endian length in front of every frame
+#define SERVER_FRAME_HEADER 4
+
+// How a connection delimits its requests, decided by its first byte
+enum framing { FRAMING_UNKNOWN, FRAMING_LINES, FRAMING_LENGTH };
+
+typedef struct connection {
+  int fd;
+  uint32_t events; // Currently registered with epoll
+  char *in;        // Bytes of the line being received
+  size_t in_len, in_cap;
+  char *out; // Responses, out_sent of them already written
+  size_t out_len, out_cap, out_sent;
+  int framing;
+  bool discarding; // Skipping the rest of an oversized line
+  size_t skip;     // Bytes of an oversized frame still to be skipped
+  bool eof;        // The peer is done writing, close once out is flushed
+  struct connection *prev, *next;
+} Connection;
+
+typedef struct server {
+  int epoll_fd;
+  int listen_fd;
+  ParseFunc parse_func;
+  Cache *cache;
+  Connection *connections;
+  BatchStats *stats;
+} Server;
+
+static volatile sig_atomic_t stop_requested = 0;
+
+static void request_stop(int signal) {
+  (void)signal;
+  stop_requested = 1;
+}
+
+static bool append_result(Connection *conn, const BatchResult *result) {
+  // Drop what was written so the buffer does not grow with the session
+  if (conn->out_sent && conn->out_sent == conn->out_len) {
+    conn->out_len = conn->out_sent = 0;
+  } else if (conn->out_sent > conn->out_cap / 2) {
+    memmove(conn->out, conn->out + conn->out_sent,
+            conn->out_len - conn->out_sent);
+    conn->out_len -= conn->out_sent;
+    conn->out_sent = 0;
+  }
+  size_t header = conn->framing == FRAMING_LENGTH ? SERVER_FRAME_HEADER : 0;
+  size_t at = conn->out_len + header;
+  if (!util_reserve((void **)&conn->out, &conn->out_cap, at + 1, 1))
+    return false;
+  int len = batch_format(result, conn->out + at, conn->out_cap - at);
+  if (at + len >= conn->out_cap) {
+    if (!util_reserve((void **)&conn->out, &conn->out_cap, at + len + 1, 1))
+      return false;
+    batch_format(result, conn->out + at, conn->out_cap - at);
+  }
+  // A framed response is the line without its newline
+  if (header) {
+    unsigned char *bytes = (unsigned char *)conn->out + conn->out_len;
+    --len;
+    bytes[0] = len >> 24;
+    bytes[1] = len >> 16;
+    bytes[2] = len >> 8;
+    bytes[3] = len;
+  }
+  conn->out_len = at + len;
+  return true;
+}
+
+static bool respond(Server *server, Connection *conn, const char *line,
+                    size_t len) {
+  BatchResult result;
+  while (len > 0 && line[len - 1] == '\r') {
+    --len;
+  }
+  batch_evaluate(line, len, server->parse_func, server->cache, &result);
+  ++(server->stats->expressions);
+  if (result.error)
+    ++(server->stats->errors);
+  bool appended = append_result(conn, &result);
+  free(result.text);
+  return appended;
+}
+
+static bool respond_error(Server *server, Connection *conn, int error) {
+  BatchResult result = {0, error, NULL};
+  ++(server->stats->expressions);
+  ++(server->stats->errors);
+  return append_result(conn, &result);
+}
+
+// Answers the complete lines from *start on, moving *start past them. A
+// line over SERVER_LINE_MAX is answered with an error as soon as it is seen
+// to be too long, complete or not, and the rest of it is skipped.
+static bool process_lines(Server *server, Connection *conn, size_t *start) {
+  char *newline;
+  while ((newline = memchr(conn->in + *start, '\n', conn->in_len - *start))) {
+    size_t end = newline - conn->in;
+    size_t len = end - *start;
+    bool answered = true;
+    if (conn->discarding)
+      conn->discarding = false;
+    else if (len > SERVER_LINE_MAX)
+      answered = respond_error(server, conn, OUT_OF_MEMORY);
+    else
+      answered = respond(server, conn, conn->in + *start, len);
+    *start = end + 1;
+    if (!answered)
+      return false;
+  }
+
+  if (!conn->discarding && conn->in_len - *start > SERVER_LINE_MAX) {
+    conn->discarding = true;
+    *start = conn->in_len;
+    return respond_error(server, conn, OUT_OF_MEMORY);
+  }
+  if (conn->discarding)
+    *start = conn->in_len;
+  return true;
+}
+
+// Answers the complete frames from *start on, moving *start past them. A
+// frame over SERVER_LINE_MAX is answered with an error when its header
+// arrives, and its bytes are skipped.
+static bool process_frames(Server *server, Connection *conn, size_t *start) {
+  for (;;) {
+    size_t available = conn->in_len - *start;
+    if (conn->skip) {
+      size_t skipped = available < conn->skip ? available : conn->skip;
+      conn->skip -= skipped;
+      *start += skipped;
+      if (conn->skip)
+        return true;
+      continue;
+    }
+    if (available < SERVER_FRAME_HEADER)
+      return true;
+    const unsigned char *header = (unsigned char *)conn->in + *start;
+    size_t len = (size_t)header[0] << 24 | (size_t)header[1] << 16 |
+                 (size_t)header[2] << 8 | header[3];
+    if (len > SERVER_LINE_MAX) {
+      *start += SERVER_FRAME_HEADER;
+      conn->skip = len;
+      if (!respond_error(server, conn, OUT_OF_MEMORY))
+        return false;
+      continue;
+    }
+    if (available - SERVER_FRAME_HEADER < len)
+      return true;
+    if (!respond(server, conn, conn->in + *start + SERVER_FRAME_HEADER, len))
+      return false;
+    *start += SERVER_FRAME_HEADER + len;
+  }
+}
+
+// Answers every complete request received so far, keeping the partial last
+// one
+static bool process_input(Server *server, Connection *conn) {
+  if (conn->framing == FRAMING_UNKNOWN)
+    conn->framing = conn->in[0] == '\0' ? FRAMING_LENGTH : FRAMING_LINES;
+  size_t start = 0;
+  bool alive = conn->framing == FRAMING_LENGTH
+                   ? process_frames(server, conn, &start)
+                   : process_lines(server, conn, &start);
+  memmove(conn->in, conn->in + start, conn->in_len - start);
+  conn->in_len -= start;
+  return alive;
+}
+
+// Writes queued responses until the socket is full, false on a dead peer
+static bool flush_output(Connection *conn) {
+  while (conn->out_sent < conn->out_len) {
+    ssize_t sent = send(conn->fd, conn->out + conn->out_sent,
+                        conn->out_len - conn->out_sent, MSG_NOSIGNAL);
+    if (sent >= 0)
+      conn->out_sent += sent;
+    else if (errno == EAGAIN || errno == EWOULDBLOCK)
+      return true;
+    else if (errno != EINTR)
+      return false;
+  }
+  conn->out_len = conn->out_sent = 0;
+  return true;
+}
+
+static void close_connection(Server *server, Connection *conn) {
+  if (conn->prev)
+    conn->prev->next = conn->next;
+  else
+    server->connections = conn->next;
+  if (conn->next)
+    conn->next->prev = conn->prev;
+  // Closing the descriptor also removes it from the epoll set
+  close(conn->fd);
+  free(conn->in);
+  free(conn->out);
+  free(conn);
+}
+
+// Reads while the peer keeps up with its responses, writes while any are
+// queued
+static void update_events(Server *server, Connection *conn) {
+  uint32_t events = 0;
+  if (!conn->eof && conn->out_len - conn->out_sent < SERVER_OUTPUT_LIMIT)
+    events |= EPOLLIN;
+  if (conn->out_sent < conn->out_len)
+    events |= EPOLLOUT;
+  if (events == conn->events)
+    return;
+  struct epoll_event event = {events, {.ptr = conn}};
+  epoll_ctl(server->epoll_fd, EPOLL_CTL_MOD, conn->fd, &event);
+  conn->events = events;
+}
+
+// Returns false once the connection should be closed
+static bool read_input(Server *server, Connection *conn) {
+  if (!util_reserve((void **)&conn->in, &conn->in_cap,
+                    conn->in_len + SERVER_READ_SIZE, 1))
+    return false;
+  ssize_t got = recv(conn->fd, conn->in + conn->in_len, SERVER_READ_SIZE, 0);
+  if (got < 0)
+    return errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR;
+  if (got == 0) {
+    // A last line without a terminator is still a request, a last frame
+    // cut short is not
+    conn->eof = true;
+    if (conn->in_len && conn->framing == FRAMING_LINES &&
+        !conn->discarding && !respond(server, conn, conn->in, conn->in_len))
+      return false;
+    conn->in_len = 0;
+    return true;
+  }
+  server->stats->bytes += got;
+  conn->in_len += got;
+  return process_input(server, conn);
+}
+
+static void handle_connection(Server *server, Connection *conn,
+                              uint32_t events) {
+  bool alive = !(events & EPOLLERR);
+  if (alive && (events & EPOLLIN))
+    alive = read_input(server, conn);
+  // Try to answer right away rather than on the next wakeup
+  if (alive)
+    alive = flush_output(conn);
+  // A peer that hung up can no longer read its responses
+  if (alive && (events & EPOLLHUP) && !(events & EPOLLIN))
+    alive = false;
+  if (alive && conn->eof && conn->out_sent == conn->out_len)
+    alive = false;
+
+  if (alive)
+    update_events(server, conn);
+  else
+    close_connection(server, conn);
+}
+
+static void accept_connections(Server *server) {
+  for (;;) {
+    int fd = accept(server->listen_fd, NULL, NULL);
+    if (fd == -1) {
+      if (errno == EINTR || errno == ECONNABORTED)
+        continue;
+      if (errno != EAGAIN && errno != EWOULDBLOCK)
+        perror("accept");
+      return;
+    }
+    fcntl(fd, F_SETFD, FD_CLOEXEC);
+    fcntl(fd, F_SETFL, O_NONBLOCK);
+    Connection *conn = calloc(1, sizeof(Connection));
+    if (!conn) {
+      close(fd);
+      continue;
+    }
+    conn->fd = fd;
+    conn->events = EPOLLIN;
+    struct epoll_event event = {EPOLLIN, {.ptr = conn}};
+    if (epoll_ctl(server->epoll_fd, EPOLL_CTL_ADD, fd, &event) == -1) {
+      close(fd);
+      free(conn);
+      continue;
+    }
+    conn->next = server->connections;
+    if (conn->next)
+      conn->next->prev = conn;
+    server->connections = conn;
+  }
+}
+
+static int open_socket(const char *path) {
+  struct sockaddr_un addr;
+  memset(&addr, 0, sizeof(addr));
+  addr.sun_family = AF_UNIX;
+  if (strlen(path) >= sizeof(addr.sun_path)) {
+    errno = ENAMETOOLONG;
+    return -1;
+  }
+  strcpy(addr.sun_path, path);
+
+  // Replace the socket of a previous run, but never another kind of file
+  struct stat st;
+  if (lstat(path, &st) == 0 && S_ISSOCK(st.st_mode))
+    unlink(path);
+
+  int fd = socket(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+  if (fd == -1)
+    return -1;
+  if (bind(fd, (struct sockaddr *)&addr, sizeof(addr)) == -1 ||
+      listen(fd, SOMAXCONN) == -1) {
+    int saved = errno;
+    close(fd);
+    errno = saved;
+    return -1;
+  }
+  return fd;
+}
+
+bool server_run(const char *path, BatchOptions *options, BatchStats *stats) {
+  Server server;
+  memset(&server, 0, sizeof(server));
+  memset(stats, 0, sizeof(*stats));
+  server.parse_func = options->parse_func;
+  server.stats = stats;
+  if (options->threads != 1) {
+    errno = EINVAL;
+    return false;
+  }
+
+  server.listen_fd = open_socket(path);
+  if (server.listen_fd == -1)
+    return false;
+  server.epoll_fd = epoll_create1(EPOLL_CLOEXEC);
+  struct epoll_event event = {EPOLLIN, {.ptr = NULL}};
+  if (server.epoll_fd == -1 ||
+      epoll_ctl(server.epoll_fd, EPOLL_CTL_ADD, server.listen_fd, &event) ==
+          -1) {
+    int saved = errno;
+    if (server.epoll_fd != -1)
+      close(server.epoll_fd);
+    close(server.listen_fd);
+    unlink(path);
+    errno = saved;
+    return false;
+  }
+  // Cache entries hold a long int, precise results are text of any length
+  server.cache = options->cache_bytes && !parser_precise_flag
+                     ? cache_new(options->cache_bytes)
+                     : NULL;
+
+  // The stop signals are only delivered inside epoll_pwait, so one arriving
+  // between the flag check and the wait cannot be lost
+  struct sigaction action;
+  memset(&action, 0, sizeof(action));
+  action.sa_handler = request_stop;
+  sigemptyset(&action.sa_mask);
+  sigaction(SIGINT, &action, NULL);
+  sigaction(SIGTERM, &action, NULL);
+  sigset_t blocked, saved_mask, wait_mask;
+  sigemptyset(&blocked);
+  sigaddset(&blocked, SIGINT);
+  sigaddset(&blocked, SIGTERM);
+  sigprocmask(SIG_BLOCK, &blocked, &saved_mask);
+  wait_mask = saved_mask;
+  sigdelset(&wait_mask, SIGINT);
+  sigdelset(&wait_mask, SIGTERM);
+
+  fprintf(stderr, "Listening on %s\n", path);
+  double start = util_seconds();
+  struct epoll_event events[SERVER_EVENTS];
+  while (!stop_requested) {
+    int count =
+        epoll_pwait(server.epoll_fd, events, SERVER_EVENTS, -1, &wait_mask);
+    for (int ix = 0; ix < count; ix++) {
+      if (events[ix].data.ptr)
+        handle_connection(&server, events[ix].data.ptr, events[ix].events);
+      else
+        accept_connections(&server);
+    }
+  }
+  stats->seconds = util_seconds() - start;
+
+  while (server.connections) {
+    close_connection(&server, server.connections);
+  }
+  if (server.cache) {
+    stats->cached = true;
+    cache_get_stats(server.cache, &stats->cache);
+    cache_free(server.cache);
+  }
+  close(server.epoll_fd);
+  close(server.listen_fd);
+  unlink(path);
+  sigprocmask(SIG_SETMASK, &saved_mask, NULL);
+  return true;
+}
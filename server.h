@@ -0,0 +1,42 @@
+#ifndef SERVER_H
+#define SERVER_H
+
+#include <stdbool.h>
+#include "batch.h"
+
+/*
+  Local evaluation daemon. Clients connect to a Unix domain stream socket
+  and write newline-delimited expressions; every line gets exactly one
+  response line, in request order, formatted like batch_run output.
+  Requests are pipelined: a client may write any number of lines before
+  reading, the server keeps reading while responses are queued and only
+  stops when a connection has SERVER_OUTPUT_LIMIT bytes of them unread.
+
+  A connection whose first byte is zero uses length-prefixed frames
+  instead: each request is a 4-byte big-endian length followed by that many
+  bytes of expression, and each response is framed the same way around the
+  response line without its newline. No expression starts with a zero
+  byte, while the length of an accepted frame always does.
+*/
+
+// Longest accepted line or frame, longer ones get an OUT_OF_MEMORY error
+#define SERVER_LINE_MAX (1 << 20)
+// Queued response bytes past which a connection is not read from
+#define SERVER_OUTPUT_LIMIT (4 << 20)
+
+/**
+ * @brief Serves expressions on a Unix domain socket until SIGINT or SIGTERM.
+ *
+ * Connections are multiplexed on one thread with epoll, so options->threads
+ * must be 1. A stale socket file at path is replaced, and the socket is
+ * removed again on shutdown.
+ *
+ * @param path The socket path.
+ * @param options How the lines are evaluated.
+ * @param stats Receives the expression and error counts over all clients.
+ * @return bool false if the socket could not be set up or options->threads
+ *              is not 1, with errno set.
+ */
+bool server_run(const char *path, BatchOptions *options, BatchStats *stats);
+
+#endif
@@ -1,24 +1,15 @@
 #include <stdlib.h>
+#include <string.h>
 #include "stack.h"
 
-struct node {
-    long int value;
-    struct node *next;
-};
-
-Node *node_create(long int value)
-{
-    Node *new_node = (Node *)malloc(sizeof *new_node);
-    new_node->value = value;
-    new_node->next = NULL;
-    return new_node;
-}
-
 Stack *stack_create()
 {
     Stack *temp = (Stack *)malloc(sizeof *temp);
-    temp->entries = NULL;
+    if (!temp)
+        return NULL;
+    temp->entries = temp->inline_entries;
     temp->size = 0;
+    temp->capacity = STACK_INLINE_CAPACITY;
     return temp;
 }
 
@@ -26,63 +17,79 @@ void stack_free(Stack *stack)
 {
   if (!stack)
     return;
-  
-  Node *node = stack->entries;
-  while (node)
-  {
-    Node *next = node->next;
-    free(node);
-    node = next;
-  }
+
+  if (stack->entries != stack->inline_entries)
+    free(stack->entries);
   free(stack);
 }
 
+// Doubles the capacity, moving off the inline storage on the first growth.
+// Returns false and keeps the current entries if memory runs out.
+static bool stack_grow(Stack *stack)
+{
+    size_t capacity = stack->capacity * 2;
+    long int *entries;
+    if (stack->entries == stack->inline_entries)
+    {
+        entries = malloc(capacity * sizeof *stack->entries);
+        if (entries)
+            memcpy(entries, stack->inline_entries, stack->size * sizeof *stack->entries);
+    }
+    else
+    {
+        entries = realloc(stack->entries, capacity * sizeof *stack->entries);
+    }
+    if (!entries)
+        return false;
+    stack->entries = entries;
+    stack->capacity = capacity;
+    return true;
+}
+
 long int stack_pop(Stack *stack, int *errno)
 {
-    if (stack->entries == NULL)
+    if (stack->size == 0)
     {
         *errno = STACK_UNDERFLOW;
         return 0;
     }
 
-    Node *top = stack->entries;
-    long int val = top->value;
-    stack->entries = stack->entries->next;
-    free(top);
-    stack->size--;
-    return val;
+    return stack->entries[--stack->size];
 }
 
-void stack_push(Stack *stack, long int value)
+long int stack_peek(Stack *stack, int *errno)
 {
-    Node *temp = node_create(value);
-
-    if (stack->entries == NULL)
+    if (stack->size == 0)
     {
-        stack->entries = temp;
+        *errno = STACK_UNDERFLOW;
+        return 0;
     }
-    else
+
+    return stack->entries[stack->size - 1];
+}
+
+bool stack_push(Stack *stack, long int value)
+{
+    if (stack->size == stack->capacity && !stack_grow(stack))
     {
-        temp->next = stack->entries;
-        stack->entries = temp;
+        return false;
     }
-  
-    stack->size++;
+
+    stack->entries[stack->size++] = value;
+    return true;
 }
 
 void stack_print(Stack *stack)
 {
     if (stack)
     {
-      Node *top = stack->entries;
-      while(top)
+      for (size_t ix = stack->size; ix > 0; ix--)
       {
-        printf("|%ld\n", top->value);
-        if (!top->next)
+        printf("|%ld\n", stack->entries[ix - 1]);
+        if (ix == 1)
         {
             printf("----\n");
         }
-        top = top->next;
       }
     }
     else
@@ -93,17 +100,10 @@ void stack_print(Stack *stack)
 
 size_t stack_size(Stack *stack)
 {
-  int count = 0;
-  Node* node = stack->entries;
-  while (node)
-  {
-    node = node->next;
-    ++count;
-  }
-  return count;
+  return stack->size;
 }
 
 int stack_empty(Stack *stack)
 {
     return stack == NULL || stack->size == 0;
-}
\ No newline at end of file
+}
@@ -1,13 +1,15 @@
+#include <stdbool.h>
 #include <stdio.h>
 
-struct node;
-
-typedef struct node Node;
+// Entries live inline until the stack grows past this many values
+#define STACK_INLINE_CAPACITY 32
 
 typedef struct stack
 {
-    Node *entries;
+    long int *entries;
     size_t size;
+    size_t capacity;
+    long int inline_entries[STACK_INLINE_CAPACITY];
 } Stack;
 
 enum Errors
@@ -19,7 +21,7 @@ enum Errors
 /**
  * @brief Create a Stack object.
  *
- * @return Stack* The new stack object.
+ * @return Stack* The new stack object, or NULL if memory runs out.
  */
 Stack *stack_create();
 
@@ -36,13 +38,22 @@ void stack_free(Stack *stack);
  */
 long int stack_pop(Stack *stack, int *error);
 
+/**
+ * @brief Returns the top item on the stack without removing it.
+ *
+ * @param stack The current stack.
+ * @return long int The value on the top of the stack.
+ */
+long int stack_peek(Stack *stack, int *error);
+
 /**
  * @brief Adds an item to the top of the stack.
  *
  * @param stack The current stack.
  * @param value The value to add to the top of the stack.
+ * @return bool false if the stack could not grow, it is left unchanged.
  */
-void stack_push(Stack *stack, long int value);
+bool stack_push(Stack *stack, long int value);
 
 /**
  * @brief Prints the values in the current stack.
@@ -0,0 +1,152 @@
+/*
+  Differential test of the engines. Random expressions over a few variables
+  are evaluated by the stack engine straight from the parse, which is the
+  reference, and then as optimized Programs on the stack, threaded and JIT
+  engines. Every engine must give the reference result or error, first
+  with checked arithmetic and then without it, where only expressions that
+  neither overflow nor divide by zero are run.
+
+  Usage: tests/differential [seed [count]]
+*/
+#include "parser.h"
+#include "program.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define DEFAULT_COUNT 20000
+#define MAX_DEPTH 6
+#define POOL_SIZE 8
+#define TEXT_LEN (1 << 16)
+
+static const char *engines[] = {"stack", "threaded", "jit"};
+static const char *names[] = {"a", "b", "c"};
+
+// Subexpressions already written, repeated to exercise the optimizer's
+// sharing of common subexpressions
+static char *pool[POOL_SIZE];
+static int pool_count;
+
+static void generate(char **out, int depth) {
+  int choice = rand() % 10;
+  if (pool_count && choice < 2) {
+    *out += sprintf(*out, "%s", pool[rand() % pool_count]);
+    return;
+  }
+  if (depth == 0 || choice < 5) {
+    if (rand() % 2)
+      *out += sprintf(*out, "%s", names[rand() % 3]);
+    else
+      *out += sprintf(*out, "%d", rand() % 21 - 10);
+    return;
+  }
+  if (rand() % 8 == 0) {
+    *out += sprintf(*out, "abs(");
+    generate(out, depth - 1);
+    *out += sprintf(*out, ")");
+    return;
+  }
+
+  static const char operators[] = "+-*/%^";
+  char *start = *out;
+  *out += sprintf(*out, "(");
+  generate(out, depth - 1);
+  *out += sprintf(*out, " %c ", operators[rand() % 6]);
+  generate(out, depth - 1);
+  *out += sprintf(*out, ")");
+  if (pool_count < POOL_SIZE && rand() % 3 == 0)
+    pool[pool_count++] = strndup(start, *out - start);
+}
+
+// Binds the variables of the program in slot order
+static void bind(const Program *program, const long int *by_name,
+                 long int *values) {
+  for (int slot = 0; slot < program_variable_count(program); slot++) {
+    values[slot] = by_name[program_variable_name(program, slot)[0] - 'a'];
+  }
+}
+
+// The parse evaluated as is, without the optimizer
+static long int reference(char *text, const long int *by_name, int *error) {
+  Parser *parser = parser_new(text, strlen(text));
+  long int result = 0;
+  *error = VALID;
+  if (parser_parse_infix(parser)) {
+    long int values[3];
+    for (int slot = 0; slot < parser_variable_count(parser); slot++) {
+      size_t len;
+      values[slot] = by_name[parser_variable_name(parser, slot, &len)[0] - 'a'];
+    }
+    int len;
+    const Instruction *code = parser_instructions(parser, &len);
+    parser_set_engine("stack");
+    result = parser_execute(code, len, values, error);
+  } else {
+    *error = parser_parse_error(parser);
+  }
+  parser_free(parser);
+  return result;
+}
+
+// Returns the number of engines that disagree with the reference
+static int compare(char *text, const long int *by_name, long int expected,
+                   int expected_error) {
+  int failures = 0;
+  for (int engine = 0; engine < 3; engine++) {
+    parser_set_engine(engines[engine]);
+    int err = VALID;
+    long int result = 0;
+    Program *program = program_compile(text, parser_parse_infix, &err);
+    if (program) {
+      long int values[3];
+      bind(program, by_name, values);
+      result = program_evaluate(program, values, &err);
+      program_free(program);
+    }
+    if (err != expected_error || (!err && result != expected)) {
+      if (failures++ == 0)
+        fprintf(stderr, "%s with a=%ld b=%ld c=%ld%s:\n", text, by_name[0],
+                by_name[1], by_name[2], parser_checked_flag ? ", checked" : "");
+      fprintf(stderr, "  %s gives %ld (error %d), expected %ld (error %d)\n",
+              engines[engine], result, err, expected, expected_error);
+    }
+  }
+  return failures;
+}
+
+int main(int argc, char *argv[]) {
+  unsigned int seed = argc > 1 ? atoi(argv[1]) : 1;
+  int count = argc > 2 ? atoi(argv[2]) : DEFAULT_COUNT;
+  char *text = malloc(TEXT_LEN);
+  long int checked_runs = 0, unchecked_runs = 0, failures = 0;
+
+  srand(seed);
+  for (int ix = 0; ix < count; ix++) {
+    for (int px = 0; px < pool_count; px++) {
+      free(pool[px]);
+    }
+    pool_count = 0;
+    char *out = text;
+    generate(&out, MAX_DEPTH);
+    long int by_name[3] = {rand() % 7 - 3, rand() % 7 - 3, rand() % 100};
+
+    parser_checked_flag = 1;
+    int error;
+    long int expected = reference(text, by_name, &error);
+    failures += compare(text, by_name, expected, error) > 0;
+    ++checked_runs;
+
+    // Unchecked arithmetic wraps or traps where checked reports an error
+    if (error)
+      continue;
+    parser_checked_flag = 0;
+    failures += compare(text, by_name, expected, VALID) > 0;
+    ++unchecked_runs;
+  }
+  free(text);
+
+  printf("differential: seed %u, %ld checked and %ld unchecked expressions "
+         "on 3 engines, %ld failures\n",
+         seed, checked_runs, unchecked_runs, failures);
+  return failures ? 1 : 0;
+}
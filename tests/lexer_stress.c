@@ -0,0 +1,126 @@
+/*
+  Runs many lexers and parsers at once over a shared set of inputs and
+  checks every thread sees exactly the tokens and results of a lone
+  lexer. Built normally by `make test`, and with ThreadSanitizer by
+  `make tsan`, which also reports any shared state the threads race on.
+*/
+#include "lexer.h"
+#include "parser.h"
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define THREADS 32
+#define ROUNDS 200
+#define MAX_TOKENS 64
+
+static const char *inputs[] = {
+    "33",
+    "4 + 4",
+    "(4 + 9/2 - -8)^3 + abs(15 % 4 - 5*2)",
+    "2^3^2",
+    "(5+(10*(5+5)))",
+    "4 9 2 / + -8 - 3 ^ 15 4 % 5 2 * - abs +",
+    "   \t 123456789012345678 \n - 98765432109876543",
+    "99999999999999999999999 + 1",
+    "(price * qty) % 7",
+    "abs(-12) * abs(x_1 - y2)",
+    "1-2-3-4-5-6-7-8-9",
+    "((((((((((1))))))))))",
+    "7 $ 3",
+    "",
+};
+#define INPUT_COUNT ((int)(sizeof(inputs) / sizeof(char *)))
+
+typedef struct expected {
+  Token tokens[MAX_TOKENS];
+  int count;
+  bool valid;
+  long int result;
+  int error;
+} Expected;
+
+static Expected expected[INPUT_COUNT];
+
+typedef struct worker {
+  pthread_t thread;
+  int index;
+  long int failures;
+} Worker;
+
+// Lexes input until end, returns the number of tokens
+static int lex(const char *input, Token *tokens) {
+  Lexer *lexer = lexer_new(input, strlen(input));
+  int count = 0;
+  do {
+    lexer_advance_token(lexer);
+    tokens[count] = *lexer_get_token(lexer);
+  } while (tokens[count++].type != end && count < MAX_TOKENS);
+  lexer_free(lexer);
+  return count;
+}
+
+static bool same_token(const Token *a, const Token *b) {
+  return a->type == b->type && a->offset == b->offset && a->len == b->len &&
+         (a->type != number ||
+          (a->value == b->value && a->overflow == b->overflow));
+}
+
+static void evaluate(const char *input, Expected *outcome) {
+  Parser *parser = parser_new(input, strlen(input));
+  outcome->valid = parser_parse_infix(parser);
+  outcome->error = 0;
+  outcome->result =
+      outcome->valid ? parser_evaluate(parser, &outcome->error) : 0;
+  parser_free(parser);
+}
+
+static void *run_worker(void *arg) {
+  Worker *worker = arg;
+  Token tokens[MAX_TOKENS];
+  for (int round = 0; round < ROUNDS; round++) {
+    // Threads start on different inputs so they overlap on all of them
+    int ix = (worker->index + round) % INPUT_COUNT;
+    int count = lex(inputs[ix], tokens);
+    bool same = count == expected[ix].count;
+    for (int tx = 0; tx < count && same; tx++) {
+      same = same_token(&tokens[tx], &expected[ix].tokens[tx]);
+    }
+
+    Expected outcome;
+    evaluate(inputs[ix], &outcome);
+    same = same && outcome.valid == expected[ix].valid &&
+           outcome.result == expected[ix].result &&
+           outcome.error == expected[ix].error;
+    if (!same) {
+      fprintf(stderr, "thread %d: \"%s\" differs\n", worker->index,
+              inputs[ix]);
+      ++(worker->failures);
+    }
+  }
+  return NULL;
+}
+
+int main() {
+  for (int ix = 0; ix < INPUT_COUNT; ix++) {
+    expected[ix].count = lex(inputs[ix], expected[ix].tokens);
+    evaluate(inputs[ix], &expected[ix]);
+  }
+
+  Worker workers[THREADS];
+  for (int ix = 0; ix < THREADS; ix++) {
+    workers[ix].index = ix;
+    workers[ix].failures = 0;
+    pthread_create(&workers[ix].thread, NULL, run_worker, &workers[ix]);
+  }
+  long int failures = 0;
+  for (int ix = 0; ix < THREADS; ix++) {
+    pthread_join(workers[ix].thread, NULL);
+    failures += workers[ix].failures;
+  }
+
+  printf("lexer_stress: %d threads x %d rounds, %ld differences\n", THREADS,
+         ROUNDS, failures);
+  return failures ? 1 : 0;
+}
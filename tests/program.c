@@ -0,0 +1,143 @@
+/*
+  Compiles expressions with variables into Programs and checks their values
+  against known results, with both infix parsers and on every engine.
+*/
+#include "parser.h"
+#include "program.h"
+#include <limits.h>
+#include <stdio.h>
+#include <string.h>
+
+typedef struct test_case {
+  char *src;
+  long int x, y; // Bindings of the variables x and y where they are used
+  long int expected;
+  int error; // Expected compile or evaluation error, VALID for none
+} TestCase;
+
+static const TestCase cases[] = {
+    {"x", 7, 0, 7, VALID},
+    {"(x * y) % 7", 120, 3, 3, VALID},
+    {"x + -1", 5, 0, 4, VALID},
+    // A '-' right after a variable is the operator, not a negative literal
+    {"x-1", 5, 0, 4, VALID},
+    {"x-2*y", 10, 3, 4, VALID},
+    {"x -2", 5, 0, 3, VALID},
+    {"abs(x-10)", 4, 0, 6, VALID},
+    {"(x-1)*(x-1) + y-1", 3, 2, 5, VALID},
+    {"x^2-y^2", 5, 4, 9, VALID},
+    {"x y", 1, 2, 0, INVALID_EXPRESSION},
+    {"x -", 1, 0, 0, INVALID_EXPRESSION},
+};
+#define CASE_COUNT ((int)(sizeof(cases) / sizeof(TestCase)))
+
+static const char *engines[] = {"stack", "threaded", "jit"};
+
+static int run_case(const TestCase *test, ParseFunc parse_func,
+                    const char *engine) {
+  int err = VALID;
+  Program *program = program_compile(test->src, parse_func, &err);
+  long int result = 0;
+  if (program) {
+    long int values[2];
+    for (int slot = 0; slot < program_variable_count(program); slot++) {
+      values[slot] = strcmp(program_variable_name(program, slot), "x")
+                         ? test->y
+                         : test->x;
+    }
+    result = program_evaluate(program, values, &err);
+    program_free(program);
+  }
+  if (err == test->error && (err || result == test->expected))
+    return 0;
+  fprintf(stderr, "%s on %s: got %ld (error %d), expected %ld (error %d)\n",
+          test->src, engine, result, err, test->expected, test->error);
+  return 1;
+}
+
+int main() {
+  int failures = 0, runs = 0;
+  ParseFunc parsers[] = {parser_parse_infix, parser_parse_infix_iterative};
+  for (int engine = 0; engine < 3; engine++) {
+    parser_set_engine(engines[engine]);
+    for (int parse = 0; parse < 2; parse++) {
+      for (int ix = 0; ix < CASE_COUNT; ix++) {
+        failures += run_case(&cases[ix], parsers[parse], engines[engine]);
+        ++runs;
+      }
+    }
+  }
+
+  // Checked arithmetic is fixed when a Program is compiled, changing the
+  // mode afterwards does not affect it
+  TestCase overflow = {"x * y", LONG_MAX, 2, -2, VALID};
+  for (int engine = 0; engine < 3; engine++) {
+    parser_set_engine(engines[engine]);
+    for (int checked = 0; checked < 2; checked++) {
+      parser_checked_flag = checked;
+      int err = VALID;
+      Program *program = program_compile(overflow.src, parsers[0], &err);
+      parser_checked_flag = !checked;
+      long int values[2] = {overflow.x, overflow.y};
+      long int result = program_evaluate(program, values, &err);
+      program_free(program);
+      int expected = checked ? ARITHMETIC_OVERFLOW : VALID;
+      if (err != expected || (!err && result != overflow.expected)) {
+        fprintf(stderr, "%s compiled %s on %s: got %ld (error %d)\n",
+                overflow.src, checked ? "checked" : "unchecked",
+                engines[engine], result, err);
+        ++failures;
+      }
+      ++runs;
+    }
+  }
+  parser_checked_flag = 0;
+
+  // Literals past a long int only run on the bignum engine, Programs reject
+  // them rather than evaluate them as garbage
+  parser_precise_mode();
+  for (int engine = 0; engine < 3; engine++) {
+    parser_set_engine(engines[engine]);
+    TestCase big = {"99999999999999999999 + x", 1, 0, 0, NUMBER_OVERFLOW};
+    failures += run_case(&big, parsers[0], engines[engine]);
+    ++runs;
+  }
+  parser_precise_flag = 0;
+  parser_set_engine("stack");
+
+  // Float mode Programs evaluate in double precision on every engine, and
+  // lex numbers separately so "x-1" must still parse
+  parser_float_mode();
+  static const struct {
+    char *src;
+    long int x;
+    double expected;
+  } reals[] = {
+      {"1.5 + 2.25", 0, 3.75},
+      {"x-1", 5, 4.0},
+      {"x / 4", 3, 0.75},
+      {"2 * (x - 0.5)", 2, 3.0},
+  };
+  for (int engine = 0; engine < 3; engine++) {
+    parser_set_engine(engines[engine]);
+    for (int ix = 0; ix < (int)(sizeof(reals) / sizeof(reals[0])); ix++) {
+      int err = VALID;
+      double result = 0;
+      Program *program = program_compile(reals[ix].src, parsers[0], &err);
+      if (program) {
+        result = program_evaluate_real(program, &reals[ix].x, &err);
+        program_free(program);
+      }
+      if (err || result != reals[ix].expected) {
+        fprintf(stderr, "%s in float mode on %s: got %g (error %d)\n",
+                reals[ix].src, engines[engine], result, err);
+        ++failures;
+      }
+      ++runs;
+    }
+  }
+  parser_set_engine("stack");
+
+  printf("program: %d runs, %d failures\n", runs, failures);
+  return failures ? 1 : 0;
+}
@@ -0,0 +1,257 @@
+#include "threaded.h"
+#include "arith.h"
+#include <stdlib.h>
+
+// Programs up to this deep evaluate on the C stack
+#define LOCAL_DEPTH 64
+
+typedef struct threaded_op {
+  const void *target;
+  long int operand;
+} ThreadedOp;
+
+struct threaded_code {
+  int max_depth;
+  ThreadedOp ops[];
+};
+
+// Handler slots after the opcodes, which index the table directly. Checked
+// arithmetic uses a second copy of the opcode slots from HANDLER_CHECKED on.
+enum {
+  HANDLER_HALT = load_temp + 1,
+  HANDLER_INVALID,
+  HANDLER_CHECKED,
+  HANDLER_COUNT = HANDLER_CHECKED + load_temp + 1
+};
+
+/*
+  Runs threaded code. The code was verified, so handlers take their operands
+  without checking the stack. Handler addresses only exist inside this
+  function, so calling it with handlers set returns the table for
+  threaded_compile instead.
+*/
+static long int run(const ThreadedOp *ip, const long int *values,
+                    long int *stack, int *error, const void *const **handlers) {
+  static const void *const table[HANDLER_COUNT] = {
+      [add] = &&op_add,           [sub] = &&op_sub,
+      [mul] = &&op_mul,           [divide] = &&op_div,
+      [mod] = &&op_mod,           [power] = &&op_pow,
+      [absolute] = &&op_abs,      [number] = &&op_push,
+      [variable] = &&op_load,     [add_imm] = &&op_add_imm,
+      [sub_imm] = &&op_sub_imm,   [mul_imm] = &&op_mul_imm,
+      [divide_imm] = &&op_div_imm, [mod_imm] = &&op_mod_imm,
+      [power_imm] = &&op_pow_imm, [store_temp] = &&op_store_temp,
+      [load_temp] = &&op_load_temp, [HANDLER_HALT] = &&op_halt,
+      [HANDLER_INVALID] = &&op_invalid,
+      [HANDLER_CHECKED + add] = &&op_add_checked,
+      [HANDLER_CHECKED + sub] = &&op_sub_checked,
+      [HANDLER_CHECKED + mul] = &&op_mul_checked,
+      [HANDLER_CHECKED + divide] = &&op_div_checked,
+      [HANDLER_CHECKED + mod] = &&op_mod_checked,
+      [HANDLER_CHECKED + power] = &&op_pow,
+      [HANDLER_CHECKED + absolute] = &&op_abs_checked,
+      [HANDLER_CHECKED + number] = &&op_push,
+      [HANDLER_CHECKED + variable] = &&op_load,
+      [HANDLER_CHECKED + add_imm] = &&op_add_imm_checked,
+      [HANDLER_CHECKED + sub_imm] = &&op_sub_imm_checked,
+      [HANDLER_CHECKED + mul_imm] = &&op_mul_imm_checked,
+      [HANDLER_CHECKED + divide_imm] = &&op_div_imm_checked,
+      [HANDLER_CHECKED + mod_imm] = &&op_mod_imm_checked,
+      [HANDLER_CHECKED + power_imm] = &&op_pow_imm,
+      [HANDLER_CHECKED + store_temp] = &&op_store_temp,
+      [HANDLER_CHECKED + load_temp] = &&op_load_temp};
+  long int *sp = stack;
+  long int temps[MAX_TEMPS];
+  int err;
+
+  if (handlers) {
+    *handlers = table;
+    return 0;
+  }
+
+#define NEXT() goto *(++ip)->target
+
+  goto *ip->target;
+
+op_add:
+  --sp;
+  sp[-1] = sp[-1] + sp[0];
+  NEXT();
+op_sub:
+  --sp;
+  sp[-1] = sp[-1] - sp[0];
+  NEXT();
+op_mul:
+  --sp;
+  sp[-1] = sp[-1] * sp[0];
+  NEXT();
+op_div:
+  --sp;
+  sp[-1] = sp[-1] / sp[0];
+  NEXT();
+op_mod:
+  --sp;
+  sp[-1] = sp[-1] % sp[0];
+  NEXT();
+op_pow:
+  --sp;
+  if ((err = arith_pow(sp[-1], sp[0], &sp[-1])))
+    goto arith_error;
+  NEXT();
+op_abs:
+  sp[-1] = labs(sp[-1]);
+  NEXT();
+op_add_imm:
+  sp[-1] = sp[-1] + ip->operand;
+  NEXT();
+op_sub_imm:
+  sp[-1] = sp[-1] - ip->operand;
+  NEXT();
+op_mul_imm:
+  sp[-1] = sp[-1] * ip->operand;
+  NEXT();
+op_div_imm:
+  sp[-1] = sp[-1] / ip->operand;
+  NEXT();
+op_mod_imm:
+  sp[-1] = sp[-1] % ip->operand;
+  NEXT();
+op_pow_imm:
+  if ((err = arith_pow(sp[-1], ip->operand, &sp[-1])))
+    goto arith_error;
+  NEXT();
+op_add_checked:
+  --sp;
+  if ((err = arith_add(sp[-1], sp[0], &sp[-1])))
+    goto arith_error;
+  NEXT();
+op_sub_checked:
+  --sp;
+  if ((err = arith_sub(sp[-1], sp[0], &sp[-1])))
+    goto arith_error;
+  NEXT();
+op_mul_checked:
+  --sp;
+  if ((err = arith_mul(sp[-1], sp[0], &sp[-1])))
+    goto arith_error;
+  NEXT();
+op_div_checked:
+  --sp;
+  if ((err = arith_div(sp[-1], sp[0], &sp[-1])))
+    goto arith_error;
+  NEXT();
+op_mod_checked:
+  --sp;
+  if ((err = arith_mod(sp[-1], sp[0], &sp[-1])))
+    goto arith_error;
+  NEXT();
+op_abs_checked:
+  if ((err = arith_abs(sp[-1], &sp[-1])))
+    goto arith_error;
+  NEXT();
+op_add_imm_checked:
+  if ((err = arith_add(sp[-1], ip->operand, &sp[-1])))
+    goto arith_error;
+  NEXT();
+op_sub_imm_checked:
+  if ((err = arith_sub(sp[-1], ip->operand, &sp[-1])))
+    goto arith_error;
+  NEXT();
+op_mul_imm_checked:
+  if ((err = arith_mul(sp[-1], ip->operand, &sp[-1])))
+    goto arith_error;
+  NEXT();
+op_div_imm_checked:
+  if ((err = arith_div(sp[-1], ip->operand, &sp[-1])))
+    goto arith_error;
+  NEXT();
+op_mod_imm_checked:
+  if ((err = arith_mod(sp[-1], ip->operand, &sp[-1])))
+    goto arith_error;
+  NEXT();
+op_push:
+  *sp++ = ip->operand;
+  NEXT();
+op_load:
+  if (!values) {
+    *error = UNBOUND_VARIABLE;
+    return 0;
+  }
+  *sp++ = values[ip->operand];
+  NEXT();
+op_store_temp:
+  temps[ip->operand] = sp[-1];
+  NEXT();
+op_load_temp:
+  *sp++ = temps[ip->operand];
+  NEXT();
+op_halt:
+  // Verified code leaves exactly one value
+  return stack[0];
+op_invalid:
+  *error = INVALID_EXPRESSION;
+  return 0;
+arith_error:
+  *error = err;
+  return 0;
+
+#undef NEXT
+}
+
+ThreadedCode *threaded_compile(const Instruction *code, int len,
+                               int max_depth, bool checked) {
+  const void *const *handlers;
+  run(NULL, NULL, NULL, NULL, &handlers);
+
+  ThreadedCode *threaded =
+      malloc(sizeof(ThreadedCode) + (len + 1) * sizeof(ThreadedOp));
+  if (!threaded)
+    return NULL;
+  threaded->max_depth = max_depth;
+  for (int ix = 0; ix < len; ix++) {
+    TokenType opcode = code[ix].opcode;
+    int handler = HANDLER_INVALID;
+    if (opcode >= add && opcode <= load_temp)
+      handler = checked ? HANDLER_CHECKED + opcode : opcode;
+    if ((opcode == divide_imm || opcode == mod_imm) &&
+        arith_safe_divisor(code[ix].value))
+      handler = opcode;
+    threaded->ops[ix].target = handlers[handler];
+    threaded->ops[ix].operand = code[ix].value;
+  }
+  threaded->ops[len].target = handlers[HANDLER_HALT];
+  threaded->ops[len].operand = 0;
+
+  return threaded;
+}
+
+void threaded_free(ThreadedCode *threaded) { free(threaded); }
+
+long int threaded_run(const ThreadedCode *threaded, const long int *values,
+                      int *error) {
+  long int local[LOCAL_DEPTH];
+  if (threaded->max_depth <= LOCAL_DEPTH) {
+    return run(threaded->ops, values, local, error, NULL);
+  }
+
+  long int *stack = malloc(threaded->max_depth * sizeof(long int));
+  if (!stack) {
+    *error = OUT_OF_MEMORY;
+    return 0;
+  }
+  long int result = run(threaded->ops, values, stack, error, NULL);
+  free(stack);
+  return result;
+}
+
+long int threaded_execute(const Instruction *code, int len, int max_depth,
+                          bool checked, const long int *values, int *error) {
+  ThreadedCode *threaded = threaded_compile(code, len, max_depth, checked);
+  if (!threaded) {
+    *error = OUT_OF_MEMORY;
+    return 0;
+  }
+  long int result = threaded_run(threaded, values, error);
+  threaded_free(threaded);
+  return result;
+}
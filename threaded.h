@@ -0,0 +1,56 @@
+#ifndef THREADED_H
+#define THREADED_H
+
+#include "parser.h"
+
+/*
+  Direct-threaded interpreter: each Instruction is translated once into the
+  address of the code implementing it, and every handler jumps straight to
+  the next handler (computed goto) instead of returning to a dispatch loop.
+  Values live in a local array rather than a Stack, and there are no debug
+  hooks, so use the stack engine when tracing with -d.
+
+  Only code that verify_program accepted is run. Its depth is known and no
+  operator can run short of operands, so the handlers check nothing but the
+  arithmetic.
+*/
+
+struct threaded_code;
+typedef struct threaded_code ThreadedCode;
+
+/**
+ * @brief Translates a verified instruction stream into threaded code.
+ *
+ * @param code The instructions to translate.
+ * @param len The number of instructions.
+ * @param max_depth The depth verify_program reported for the code.
+ * @param checked Whether to use checked arithmetic, see parser_checked_mode.
+ * @return ThreadedCode* The threaded code, reusable until freed, or NULL if
+ *                       memory runs out.
+ */
+ThreadedCode *threaded_compile(const Instruction *code, int len,
+                               int max_depth, bool checked);
+
+/**
+ * @brief Releases threaded code.
+ */
+void threaded_free(ThreadedCode *threaded);
+
+/**
+ * @brief Runs threaded code, with the same results and errors as the stack
+ *        engine.
+ *
+ * @param values The variable bindings by slot, may be NULL.
+ * @return long int The result, or 0 with OUT_OF_MEMORY if a deep program's
+ *                  values could not be allocated.
+ */
+long int threaded_run(const ThreadedCode *threaded, const long int *values,
+                      int *error);
+
+/**
+ * @brief Translates and runs a verified instruction stream once.
+ */
+long int threaded_execute(const Instruction *code, int len, int max_depth,
+                          bool checked, const long int *values, int *error);
+
+#endif
@@ -0,0 +1,172 @@
+#include "threadpool.h"
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdlib.h>
+
+// Indices an owner takes from its own deque at a time
+#define TASK_GRAIN 64
+
+typedef struct worker {
+  pthread_t thread;
+  pthread_mutex_t lock;
+  // Remaining range [next, end): the owner pops from next, thieves from end
+  size_t next;
+  size_t end;
+  int id;
+  struct thread_pool *pool;
+} Worker;
+
+struct thread_pool {
+  Worker *workers;
+  int count;
+
+  pthread_mutex_t lock;
+  pthread_cond_t start;
+  pthread_cond_t done;
+  unsigned long generation;
+  int finished;
+  bool shutdown;
+
+  TaskFunc task;
+  void *context;
+};
+
+static bool take_local(Worker *worker, size_t *lo, size_t *hi) {
+  bool found = false;
+  pthread_mutex_lock(&worker->lock);
+  if (worker->next < worker->end) {
+    *lo = worker->next;
+    *hi = worker->end - worker->next > TASK_GRAIN ? worker->next + TASK_GRAIN
+                                                   : worker->end;
+    worker->next = *hi;
+    found = true;
+  }
+  pthread_mutex_unlock(&worker->lock);
+  return found;
+}
+
+// Moves the upper half of a victim's remaining range into our own deque
+static bool steal(Worker *worker) {
+  ThreadPool *pool = worker->pool;
+  for (int ix = 1; ix < pool->count; ix++) {
+    Worker *victim = &pool->workers[(worker->id + ix) % pool->count];
+    size_t lo = 0, hi = 0;
+
+    pthread_mutex_lock(&victim->lock);
+    if (victim->next < victim->end) {
+      hi = victim->end;
+      lo = hi - (hi - victim->next + 1) / 2;
+      victim->end = lo;
+    }
+    pthread_mutex_unlock(&victim->lock);
+
+    if (lo < hi) {
+      pthread_mutex_lock(&worker->lock);
+      worker->next = lo;
+      worker->end = hi;
+      pthread_mutex_unlock(&worker->lock);
+      return true;
+    }
+  }
+  return false;
+}
+
+static void run_tasks(Worker *worker) {
+  ThreadPool *pool = worker->pool;
+  size_t lo, hi;
+  for (;;) {
+    if (!take_local(worker, &lo, &hi)) {
+      if (!steal(worker) || !take_local(worker, &lo, &hi))
+        break;
+    }
+    for (size_t ix = lo; ix < hi; ix++) {
+      pool->task(pool->context, ix);
+    }
+  }
+}
+
+static void *worker_main(void *arg) {
+  Worker *worker = arg;
+  ThreadPool *pool = worker->pool;
+  unsigned long seen = 0;
+
+  for (;;) {
+    pthread_mutex_lock(&pool->lock);
+    while (pool->generation == seen && !pool->shutdown) {
+      pthread_cond_wait(&pool->start, &pool->lock);
+    }
+    if (pool->shutdown) {
+      pthread_mutex_unlock(&pool->lock);
+      break;
+    }
+    seen = pool->generation;
+    pthread_mutex_unlock(&pool->lock);
+
+    run_tasks(worker);
+
+    pthread_mutex_lock(&pool->lock);
+    if (++(pool->finished) == pool->count) {
+      pthread_cond_signal(&pool->done);
+    }
+    pthread_mutex_unlock(&pool->lock);
+  }
+  return NULL;
+}
+
+ThreadPool *threadpool_new(int threads) {
+  ThreadPool *pool = malloc(sizeof(ThreadPool));
+  pool->workers = calloc(threads, sizeof(Worker));
+  pool->count = threads;
+  pthread_mutex_init(&pool->lock, NULL);
+  pthread_cond_init(&pool->start, NULL);
+  pthread_cond_init(&pool->done, NULL);
+  pool->generation = 0;
+  pool->finished = 0;
+  pool->shutdown = false;
+
+  for (int ix = 0; ix < threads; ix++) {
+    Worker *worker = &pool->workers[ix];
+    pthread_mutex_init(&worker->lock, NULL);
+    worker->id = ix;
+    worker->pool = pool;
+    pthread_create(&worker->thread, NULL, worker_main, worker);
+  }
+  return pool;
+}
+
+void threadpool_free(ThreadPool *pool) {
+  pthread_mutex_lock(&pool->lock);
+  pool->shutdown = true;
+  pthread_cond_broadcast(&pool->start);
+  pthread_mutex_unlock(&pool->lock);
+
+  for (int ix = 0; ix < pool->count; ix++) {
+    pthread_join(pool->workers[ix].thread, NULL);
+    pthread_mutex_destroy(&pool->workers[ix].lock);
+  }
+  pthread_cond_destroy(&pool->done);
+  pthread_cond_destroy(&pool->start);
+  pthread_mutex_destroy(&pool->lock);
+  free(pool->workers);
+  free(pool);
+}
+
+void threadpool_run(ThreadPool *pool, TaskFunc task, void *context,
+                    size_t count) {
+  // Workers are idle here, so their deques can be refilled without locking
+  for (int ix = 0; ix < pool->count; ix++) {
+    pool->workers[ix].next = count * ix / pool->count;
+    pool->workers[ix].end = count * (ix + 1) / pool->count;
+  }
+
+  pthread_mutex_lock(&pool->lock);
+  pool->task = task;
+  pool->context = context;
+  pool->finished = 0;
+  ++(pool->generation);
+  pthread_cond_broadcast(&pool->start);
+  while (pool->finished < pool->count) {
+    pthread_cond_wait(&pool->done, &pool->lock);
+  }
+  pthread_mutex_unlock(&pool->lock);
+}
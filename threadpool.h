@@ -0,0 +1,35 @@
+#ifndef THREADPOOL_H
+#define THREADPOOL_H
+
+#include <stddef.h>
+
+struct thread_pool;
+typedef struct thread_pool ThreadPool;
+
+// Called once for every index handed to threadpool_run
+typedef void (*TaskFunc)(void *context, size_t index);
+
+/**
+ * @brief Creates a pool of worker threads.
+ *
+ * @param threads The number of workers to start.
+ * @return ThreadPool* The new pool.
+ */
+ThreadPool *threadpool_new(int threads);
+
+/**
+ * @brief Stops the workers and releases the pool.
+ */
+void threadpool_free(ThreadPool *pool);
+
+/**
+ * @brief Runs task for every index in [0, count) and waits for all of them.
+ *
+ * Each worker starts with an even share of the indices in its own deque.
+ * Idle workers steal half of the remaining range of another worker, so
+ * uneven task costs still keep every thread busy.
+ */
+void threadpool_run(ThreadPool *pool, TaskFunc task, void *context,
+                    size_t count);
+
+#endif
@@ -0,0 +1,25 @@
+#include "util.h"
+#include <stdlib.h>
+#include <time.h>
+
+double util_seconds() {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+bool util_reserve(void **buffer, size_t *capacity, size_t count,
+                  size_t item_size) {
+  if (count <= *capacity)
+    return true;
+  size_t grown = *capacity ? *capacity : 1024;
+  while (grown < count) {
+    grown *= 2;
+  }
+  void *items = realloc(*buffer, grown * item_size);
+  if (!items)
+    return false;
+  *buffer = items;
+  *capacity = grown;
+  return true;
+}
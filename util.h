@@ -0,0 +1,33 @@
+#ifndef UTIL_H
+#define UTIL_H
+
+#include <stdbool.h>
+#include <stddef.h>
+
+/*
+  Helpers shared by the batch, bytecode, server and load generator drivers.
+*/
+
+/**
+ * @brief Reads a monotonic clock.
+ *
+ * @return double The time in seconds.
+ */
+double util_seconds();
+
+/**
+ * @brief Grows a buffer to hold at least count items.
+ *
+ * The capacity doubles from 1024 items until count fits. On failure the
+ * buffer and its capacity are left as they were.
+ *
+ * @param buffer The buffer, may point to NULL for an empty one.
+ * @param capacity The number of items the buffer holds, updated on growth.
+ * @param count The number of items needed.
+ * @param item_size The size of one item.
+ * @return bool false if the buffer could not grow.
+ */
+bool util_reserve(void **buffer, size_t *capacity, size_t count,
+                  size_t item_size);
+
+#endif
@@ -0,0 +1,64 @@
+#include "verify.h"
+#include <stdint.h>
+
+int verify_program(const Instruction *code, int len, int *max_depth) {
+  int depth = 0;
+  // Bit n is set once temporary n has been stored
+  uint64_t stored = 0;
+  *max_depth = 0;
+  for (int ix = 0; ix < len; ix++) {
+    switch (code[ix].opcode) {
+    case big_number:
+      if (!parser_precise_flag)
+        return INVALID_EXPRESSION;
+      ++depth;
+      break;
+    case variable:
+      if (code[ix].value < 0 || code[ix].value >= MAX_VARIABLES)
+        return INVALID_EXPRESSION;
+      ++depth;
+      break;
+    case number:
+      ++depth;
+      break;
+    case store_temp:
+      if (code[ix].value < 0 || code[ix].value >= MAX_TEMPS)
+        return INVALID_EXPRESSION;
+      if (depth < 1)
+        return MISSING_OPERAND;
+      stored |= (uint64_t)1 << code[ix].value;
+      break;
+    case load_temp:
+      if (code[ix].value < 0 || code[ix].value >= MAX_TEMPS ||
+          !(stored & ((uint64_t)1 << code[ix].value)))
+        return INVALID_EXPRESSION;
+      ++depth;
+      break;
+    case absolute:
+    case add_imm:
+    case sub_imm:
+    case mul_imm:
+    case divide_imm:
+    case mod_imm:
+    case power_imm:
+      if (depth < 1)
+        return MISSING_OPERAND;
+      break;
+    case add:
+    case sub:
+    case mul:
+    case divide:
+    case mod:
+    case power:
+      if (depth < 2)
+        return MISSING_OPERAND;
+      --depth;
+      break;
+    default:
+      return INVALID_EXPRESSION;
+    }
+    if (depth > *max_depth)
+      *max_depth = depth;
+  }
+  return depth == 1 ? VALID : MISSING_OPERATOR;
+}
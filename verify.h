@@ -0,0 +1,31 @@
+#ifndef VERIFY_H
+#define VERIFY_H
+
+#include "parser.h"
+
+/*
+  Static stack verification. Every opcode has a fixed stack effect and the
+  instruction stream has no branches, so one pass finds whether a program
+  can underflow, how deep its stack gets and whether it leaves exactly one
+  value. Engines given verified code need no operand checks at run time.
+*/
+
+/**
+ * @brief Checks the stack effects of an instruction stream.
+ *
+ * Errors are reported for the first instruction at fault, as an engine
+ * running the code would have met them.
+ *
+ * @param code The instructions to check.
+ * @param len The number of instructions.
+ * @param max_depth Receives the most values the stack ever holds.
+ * @return int VALID, INVALID_EXPRESSION for an unknown opcode, variable
+ *             slot or temporary, or a load_temp before its store_temp
+ *             (big_number is only known in parser_precise_mode),
+ *             MISSING_OPERAND for an operator without enough operands, or
+ *             MISSING_OPERATOR if the program does not leave exactly one
+ *             value.
+ */
+int verify_program(const Instruction *code, int len, int *max_depth);
+
+#endif